@@ -0,0 +1,183 @@
+// golden.cc
+// This file contains code for recording golden results and checking runs
+// against them.  A golden file holds running hashes of the decoded branch
+// stream and of the prediction stream, plus the number of direction
+// mispredictions so far, at a checkpoint every so many branches and at the
+// end of the run:
+//
+// interval 16384
+// c 16384 <decode hash> <prediction hash> <mispredictions>
+// c 32768 ...
+// end <branches> <decode hash> <prediction hash> <mispredictions> <MPKI>
+//
+// When checking, the first checkpoint that doesn't match brackets the first
+// diverging branch to within one interval.  Golden results recorded with an
+// interval of 1 pin it down exactly, at the cost of a much bigger file, so
+// a known-good build can record them for just that interval: with
+// "interval 1 from N" in the header, checkpoints start after branch N, and
+// the branches before it are hashed but not checked.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "branch.h"
+#include "trace.h"
+#include "predictor.h"
+#include "golden.h"
+
+// 64-bit FNV-1a
+
+#define FNV_OFFSET	14695981039346656037ULL
+#define FNV_PRIME	1099511628211ULL
+
+// the golden file, and whether we're writing or checking it
+
+static FILE *goldenfp;
+static bool recording;
+
+// branches between checkpoints, branches seen so far, and the running hashes
+
+static long long int interval, branches, first;
+static unsigned long long decode_hash, predict_hash;
+
+// hash the four bytes of x into h
+
+static unsigned long long hash_uint (unsigned long long h, unsigned int x) {
+	for (int i=0; i<4; i++) {
+		h ^= (x >> (i * 8)) & 0xff;
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+static void golden_open (char *fname, const char *mode) {
+	goldenfp = fopen (fname, mode);
+	if (!goldenfp) {
+		perror (fname);
+		exit (1);
+	}
+	branches = 0;
+	decode_hash = FNV_OFFSET;
+	predict_hash = FNV_OFFSET;
+}
+
+// start recording golden results to fname with a checkpoint every n
+// branches, from branch from on
+
+void golden_record (char *fname, long long int n, long long int from) {
+	golden_open (fname, "w");
+	recording = true;
+	interval = n;
+	first = from;
+	if (first > 0)
+		fprintf (goldenfp, "interval %lld from %lld\n", interval, first);
+	else
+		fprintf (goldenfp, "interval %lld\n", interval);
+}
+
+// start checking against the golden results in fname
+
+void golden_verify (char *fname) {
+	golden_open (fname, "r");
+	recording = false;
+	if (fscanf (goldenfp, " interval %lld", &interval) != 1 || interval <= 0) {
+		fprintf (stderr, "%s: not a golden file\n", fname);
+		exit (1);
+	}
+	first = 0;
+	if (fscanf (goldenfp, " from %lld", &first) == 1 && first < 0) {
+		fprintf (stderr, "%s: not a golden file\n", fname);
+		exit (1);
+	}
+}
+
+// report that the golden results and this run part ways somewhere after
+// the last checkpoint that matched
+
+static void diverged (const char *what) {
+	if (interval == 1) {
+		fprintf (stderr, "%s diverges from golden results at branch %lld\n",
+			what, branches - 1);
+		return;
+	}
+	long long int from = branches - (branches - first - 1) % interval - 1;
+	fprintf (stderr, "%s diverges from golden results at a branch in [%lld, %lld)\n",
+		what, from, branches);
+}
+
+// compare this run against one golden line; true if they match
+
+static bool check (const char *kind, long long int dmiss, double mpki) {
+	char k[16];
+	long long int n, m;
+	unsigned long long d, p;
+	if (fscanf (goldenfp, " %15s %lld %llx %llx %lld", k, &n, &d, &p, &m) != 5) {
+		fprintf (stderr, "golden file is truncated after branch %lld\n", branches);
+		return false;
+	}
+	if (strcmp (k, kind) != 0 || n != branches) {
+		if (strcmp (k, "end") == 0)
+			fprintf (stderr, "golden results end at branch %lld but this run goes on\n", n);
+		else
+			fprintf (stderr, "golden results go on past branch %lld where this run ends\n", branches);
+		return false;
+	}
+	if (d != decode_hash) {
+		diverged ("decoded branch stream");
+		return false;
+	}
+	if (p != predict_hash) {
+		diverged ("prediction stream");
+		return false;
+	}
+	if (m != dmiss) {
+		diverged ("misprediction count");
+		return false;
+	}
+	if (strcmp (kind, "end") == 0) {
+		char golden_mpki[32], this_mpki[32];
+		if (fscanf (goldenfp, " %31s", golden_mpki) != 1) return false;
+		sprintf (this_mpki, "%0.3f", mpki);
+		if (strcmp (golden_mpki, this_mpki) != 0) {
+			fprintf (stderr, "MPKI %s differs from golden %s\n", this_mpki, golden_mpki);
+			return false;
+		}
+	}
+	return true;
+}
+
+// hash one branch and the prediction made for it.  dmiss is the number of
+// direction mispredictions so far, including this branch.  returns false
+// once the run has diverged from the golden results.
+
+bool golden_branch (trace *t, branch_update *u, long long int dmiss) {
+	decode_hash = hash_uint (decode_hash, t->bi.address);
+	decode_hash = hash_uint (decode_hash, t->target);
+	decode_hash = hash_uint (decode_hash, t->taken);
+	decode_hash = hash_uint (decode_hash, t->bi.opcode);
+	decode_hash = hash_uint (decode_hash, t->bi.br_flags);
+	predict_hash = hash_uint (predict_hash, u->direction_prediction ());
+	predict_hash = hash_uint (predict_hash, u->target_prediction ());
+
+	if (++branches <= first || (branches - first) % interval) return true;
+	if (recording) {
+		fprintf (goldenfp, "c %lld %016llx %016llx %lld\n",
+			branches, decode_hash, predict_hash, dmiss);
+		return true;
+	}
+	return check ("c", dmiss, 0);
+}
+
+// write or check the totals for the run; true if everything matched
+
+bool golden_finish (long long int dmiss, double mpki) {
+	bool ok = true;
+	if (recording)
+		fprintf (goldenfp, "end %lld %016llx %016llx %lld %0.3f\n",
+			branches, decode_hash, predict_hash, dmiss, mpki);
+	else
+		ok = check ("end", dmiss, mpki);
+	fclose (goldenfp);
+	return ok;
+}
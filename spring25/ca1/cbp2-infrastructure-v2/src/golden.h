@@ -0,0 +1,13 @@
+// golden.h
+// This file declares the functions that hash the stream of decoded branches
+// and the stream of predictions, so a run can be recorded as golden results
+// and later runs can be checked against them bit for bit.
+
+// default number of branches between checkpoints in a golden file
+
+#define GOLDEN_INTERVAL	16384
+
+void golden_record (char *, long long int, long long int);
+void golden_verify (char *);
+bool golden_branch (trace *, branch_update *, long long int);
+bool golden_finish (long long int, double);
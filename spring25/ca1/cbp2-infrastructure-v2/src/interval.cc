@@ -0,0 +1,128 @@
+// interval.cc
+// This file contains the interval statistics stream.  predict pushes a
+// snapshot of its counters into a ring at the end of every interval and a
+// writer thread drains the ring to the output file.  The ring is single
+// producer, single consumer, so the main loop only does a store and an
+// atomic increment per interval; it only ever waits if the writer falls a
+// whole ring behind.
+//
+// CSV output has one row per interval:
+//
+// interval,end,branches,conditional,mispredictions,mpkb,target_mispredictions,
+//	training,weak,strong,allocations
+//
+// where end is the number of branches read at the end of the interval and
+// mpkb is direction mispredictions per thousand branches.  The traces don't
+// record how many instructions lie between branches, so intervals are
+// measured in branches and rates are per branch rather than per instruction.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <atomic>
+#include <thread>
+
+#include "branch.h"
+#include "predictor.h"
+#include "interval.h"
+
+// number of snapshots the ring holds; a power of two
+
+#define RING_SIZE	4096
+
+static interval_sample ring[RING_SIZE];
+
+// head is advanced by predict, tail by the writer thread
+
+static std::atomic<unsigned long> head, tail;
+static std::atomic<bool> done;
+
+static FILE *intervalfp;
+static bool binary;
+static std::thread writer;
+
+// write one snapshot to the output file
+
+static void write_sample (const interval_sample &s, interval_sample &last, long long int n) {
+	if (binary) {
+		fwrite (&s, sizeof (s), 1, intervalfp);
+		return;
+	}
+	long long int branches = s.branches - last.branches;
+	long long int dmiss = s.dmiss - last.dmiss;
+	fprintf (intervalfp, "%lld,%lld,%lld,%lld,%lld,%0.3f,%lld,%llu,%llu,%llu,%llu\n",
+		n, s.branches, branches, s.conditional - last.conditional, dmiss,
+		branches ? 1000.0 * dmiss / branches : 0.0,
+		s.tmiss - last.tmiss,
+		s.ps.training - last.ps.training,
+		s.ps.weak - last.ps.weak,
+		s.ps.strong - last.ps.strong,
+		s.ps.allocations - last.ps.allocations);
+	last = s;
+}
+
+// the writer thread: drain the ring until predict is done and it's empty
+
+static void drain (void) {
+	interval_sample last = interval_sample ();
+	long long int n = 0;
+	for (;;) {
+		unsigned long t = tail.load (std::memory_order_relaxed);
+		if (t == head.load (std::memory_order_acquire)) {
+			if (done.load (std::memory_order_acquire)
+			 && t == head.load (std::memory_order_acquire)) break;
+
+			// nothing to write; an interval is a lot of branches,
+			// so a millisecond nap won't let the ring fill up
+
+			struct timespec ts = { 0, 1000000 };
+			nanosleep (&ts, NULL);
+			continue;
+		}
+		write_sample (ring[t % RING_SIZE], last, n++);
+		tail.store (t + 1, std::memory_order_release);
+	}
+}
+
+// start streaming interval statistics to fname, one snapshot every n
+// branches, as CSV or binary
+
+void interval_open (char *fname, long long int n, bool bin) {
+	intervalfp = fopen (fname, bin ? "wb" : "w");
+	if (!intervalfp) {
+		perror (fname);
+		exit (1);
+	}
+	binary = bin;
+	if (binary) {
+		fwrite (INTERVAL_MAGIC, 1, 8, intervalfp);
+		fwrite (&n, sizeof (n), 1, intervalfp);
+	} else {
+		fprintf (intervalfp, "interval,end,branches,conditional,mispredictions,mpkb,"
+			"target_mispredictions,training,weak,strong,allocations\n");
+	}
+	head = 0;
+	tail = 0;
+	done = false;
+	writer = std::thread (drain);
+}
+
+// hand a snapshot to the writer thread
+
+void interval_sample_push (const interval_sample &s) {
+	unsigned long h = head.load (std::memory_order_relaxed);
+	while (h - tail.load (std::memory_order_acquire) == RING_SIZE)
+		sched_yield ();
+	ring[h % RING_SIZE] = s;
+	head.store (h + 1, std::memory_order_release);
+}
+
+// wait for the writer thread to catch up and close the output file
+
+void interval_close (void) {
+	done.store (true, std::memory_order_release);
+	writer.join ();
+	fclose (intervalfp);
+}
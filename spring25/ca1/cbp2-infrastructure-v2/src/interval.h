@@ -0,0 +1,31 @@
+// interval.h
+// This file declares the interval statistics stream.  Every so many
+// branches, predict takes a snapshot of its counters and the predictor's;
+// the snapshots go into a fixed-size ring that a separate thread drains to
+// a CSV or binary file, so the main loop never waits on I/O.
+
+// default number of branches per interval
+
+#define INTERVAL_BRANCHES	100000
+
+// one snapshot.  all counts are running totals from the start of the
+// trace; the CSV writer turns them into per-interval figures, binary
+// files keep them as they are.
+
+struct interval_sample {
+	long long int
+		branches,	// branches read so far
+		conditional,	// conditional branches so far
+		dmiss,		// direction mispredictions so far
+		tmiss;		// target mispredictions so far
+	predictor_stats ps;	// the predictor's counters
+};
+
+// magic number at the start of a binary interval file, followed by the
+// interval length as a long long int and then interval_sample records
+
+#define INTERVAL_MAGIC	"CBPSTAT1"
+
+void interval_open (char *, long long int, bool);
+void interval_sample_push (const interval_sample &);
+void interval_close (void);
@@ -26,20 +26,28 @@ public:
         my_update u;
         branch_info bi;
         unsigned int history;
-        unsigned char base[1 << TABLE_BITS]; // Base predictor
         struct entry_t
         {
                 unsigned char ctr;    // 2-bit counter
                 unsigned char tag;    // 8-bit tag
                 unsigned char useful; // 2-bit useful counter
-        } tage[NHIST][1 << TABLE_BITS];
+        };
+        predictor_table<unsigned char> base;            // Base predictor
+        predictor_table<entry_t[1 << TABLE_BITS]> tage; // NHIST rows
 
         int hist_lengths[NHIST] = {4, 8, 16, 32, 64, 128}; // Longer histories now
 
-        my_predictor(void) : history(0)
+        unsigned long long allocations = 0; // Entries allocated on mispredicts
+
+        // Tables come back zero-filled from table_alloc
+        my_predictor(void)
+            : history(0), base("base", 1 << TABLE_BITS), tage("tage", NHIST)
+        {
+        }
+
+        void stats(predictor_stats &s)
         {
-                memset(base, 0, sizeof(base));
-                memset(tage, 0, sizeof(tage));
+                s.allocations = allocations;
         }
 
         branch_update *predict(branch_info &b)
@@ -134,6 +142,7 @@ public:
                                                 tage[i][idx].tag = get_tag(bi.address, history, hist_lengths[i]);
                                                 tage[i][idx].ctr = taken ? 2 : 1;
                                                 tage[i][idx].useful = 0;
+                                                allocations++;
                                                 break;
                                         }
                                 }
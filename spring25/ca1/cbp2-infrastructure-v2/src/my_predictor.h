@@ -52,11 +52,11 @@ public:
 	my_update u;
 	branch_info bi;
 
-	int ghist[GLOBAL_HISTORY_LENGTH];			   // global history
-	int g_weights[1 << TABLE_BITS][GLOBAL_HISTORY_LENGTH + 1]; // +1 for bias
+	int ghist[GLOBAL_HISTORY_LENGTH];				   // global history
+	predictor_table<int[GLOBAL_HISTORY_LENGTH + 1]> g_weights; // +1 for bias
 
-	unsigned char lhist[1 << TABLE_BITS];		      // 8-bit shift-reg
-	int l_weights[1 << TABLE_BITS][LOCAL_HISTORY_LENGTH]; // local weights
+	predictor_table<unsigned char> lhist;		      // 8-bit shift-reg
+	predictor_table<int[LOCAL_HISTORY_LENGTH]> l_weights; // local weights
 
 	// Stats
 	unsigned long long total_predictions = 0;
@@ -65,16 +65,21 @@ public:
 	unsigned long long strong_correct = 0;
 	unsigned long long strong_wrong = 0;
 
+	// tables come back zero-filled from table_alloc
 	my_predictor()
+	    : g_weights("g_weights", 1 << TABLE_BITS),
+	      lhist("lhist", 1 << TABLE_BITS),
+	      l_weights("l_weights", 1 << TABLE_BITS)
 	{
 		memset(ghist, 0, sizeof(ghist));
-		memset(g_weights, 0, sizeof(g_weights));
-		memset(lhist, 0, sizeof(lhist));
-		memset(l_weights, 0, sizeof(l_weights));
 	}
 
+	// append this run's statistics to a file in the current directory,
+	// unless a program that makes many predictors (procsim) turns it
+	// off with NO_PREDICTOR_STATS
 	~my_predictor()
 	{
+#ifndef NO_PREDICTOR_STATS
 		FILE *f = fopen("perceptron_stats.txt", "a");
 		if (!f)
 			return;
@@ -89,6 +94,15 @@ public:
 			total_predictions, total_updates, weak_predictions,
 			strong_correct, strong_wrong);
 		fclose(f);
+#endif
+	}
+
+	// counters for interval statistics
+	void stats(predictor_stats &s)
+	{
+		s.training = total_updates;
+		s.weak = weak_predictions;
+		s.strong = strong_correct + strong_wrong;
 	}
 
 	// make a direction prediction for every branch
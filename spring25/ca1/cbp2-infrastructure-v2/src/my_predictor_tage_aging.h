@@ -21,13 +21,14 @@ public:
 	my_update u;
 	branch_info bi;
 	unsigned int history;
-	unsigned char base[1 << TABLE_BITS];
 	struct entry_t
 	{
 		unsigned char ctr;
 		unsigned char tag;
 		unsigned char useful;
-	} tage[NHIST][1 << TABLE_BITS];
+	};
+	predictor_table<unsigned char> base;
+	predictor_table<entry_t[1 << TABLE_BITS]> tage; // NHIST rows
 
 	int hist_lengths[NHIST] = {4, 8, 16, 32, 64, 128};
 
@@ -44,14 +45,15 @@ public:
 	unsigned long long aging_counter = 0;
 	const unsigned long long AGING_PERIOD = 1000000; // Age every 1 million predictions
 
-	my_predictor(void) : history(0)
+	// tables come back zero-filled from table_alloc
+	my_predictor(void)
+	    : history(0), base("base", 1 << TABLE_BITS), tage("tage", NHIST)
 	{
-		memset(base, 0, sizeof(base));
-		memset(tage, 0, sizeof(tage));
 	}
 
 	~my_predictor()
 	{
+#ifndef NO_PREDICTOR_STATS
 		FILE *f = fopen("predictor_stats.txt", "a");
 		if (f)
 		{
@@ -70,6 +72,12 @@ public:
 			fprintf(f, "==============================\n");
 			fclose(f);
 		}
+#endif
+	}
+
+	void stats(predictor_stats &s)
+	{
+		s.allocations = successful_allocations;
 	}
 
 	branch_update *predict(branch_info &b)
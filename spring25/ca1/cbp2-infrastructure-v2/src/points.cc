@@ -0,0 +1,57 @@
+// points.cc
+// This file contains code for reading and writing simulation points files.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "points.h"
+
+static bool by_interval (const sim_point &a, const sim_point &b) {
+	return a.interval < b.interval;
+}
+
+// read a simulation points file; the points come back in trace order
+
+void read_points (char *fname, sim_points *s) {
+	char line[1000], what[32];
+	FILE *f = fopen (fname, "r");
+	if (!f) {
+		perror (fname);
+		exit (1);
+	}
+	s->interval = 0;
+	s->branches = 0;
+	s->n = 0;
+	while (fgets (line, sizeof (line), f)) {
+		if (line[0] == '#' || sscanf (line, "%31s", what) != 1) continue;
+		if (strcmp (what, "interval") == 0)
+			sscanf (line, "%*s %lld", &s->interval);
+		else if (strcmp (what, "branches") == 0)
+			sscanf (line, "%*s %lld", &s->branches);
+		else if (strcmp (what, "point") == 0) {
+			if (s->n == MAX_POINTS) {
+				fprintf (stderr, "%s: more than %d simulation points\n", fname, MAX_POINTS);
+				exit (1);
+			}
+			sim_point *p = &s->p[s->n++];
+			sscanf (line, "%*s %lld %lf", &p->interval, &p->weight);
+		}
+	}
+	fclose (f);
+	if (s->interval <= 0 || s->n == 0) {
+		fprintf (stderr, "%s: not a simulation points file\n", fname);
+		exit (1);
+	}
+	std::sort (s->p, s->p + s->n, by_interval);
+}
+
+// write a simulation points file
+
+void write_points (FILE *f, sim_points *s) {
+	fprintf (f, "interval %lld\n", s->interval);
+	fprintf (f, "branches %lld\n", s->branches);
+	for (int i=0; i<s->n; i++)
+		fprintf (f, "point %lld %0.6f\n", s->p[i].interval, s->p[i].weight);
+}
@@ -0,0 +1,32 @@
+// points.h
+// This file declares the simulation points file written by simpoint and
+// read by predict.  A simulation points file looks like this:
+//
+// interval 100000
+// branches 18299698
+// point 12 0.2141
+// point 57 0.0873
+// ...
+//
+// Intervals are numbered from 0 and are "interval" branches long; the
+// trace had "branches" branches in all.  Each point names one interval
+// that stands in for a cluster of similar intervals, weighted by the
+// fraction of the trace's branches that fall in that cluster.  Lines
+// starting with '#' are comments.
+
+#define MAX_POINTS	1000
+
+struct sim_point {
+	long long int interval;	// which interval to simulate
+	double weight;		// fraction of the trace it represents
+};
+
+struct sim_points {
+	long long int interval;	// branches per interval
+	long long int branches;	// branches in the whole trace
+	int n;			// number of points
+	sim_point p[MAX_POINTS];
+};
+
+void read_points (char *, sim_points *);
+void write_points (FILE *, sim_points *);
@@ -1,46 +1,203 @@
 // predict.cc
-// This file contains the main function.  The program accepts a single 
-// parameter: the name of a trace file.  It drives the branch predictor
-// simulation by reading the trace file and feeding the traces one at a time
-// to the branch predictor.
+// This file contains the main function.  The program accepts the name of
+// a trace file, optionally preceded by options controlling how predictor
+// tables are allocated.  It drives the branch predictor simulation by
+// reading the trace file and feeding the traces one at a time to the
+// branch predictor.
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h> // in case you want to use e.g. memset
 #include <assert.h>
+#include <unistd.h>
 
 #include "branch.h"
 #include "trace.h"
 #include "predictor.h"
+#include "table.h"
+#include "golden.h"
+#include "interval.h"
+#include "points.h"
+
+// the predictor under test; the regression target builds one predict
+// binary per predictor header by defining PREDICTOR
+
+#ifdef PREDICTOR
+#include PREDICTOR
+#else
 #include "my_predictor.h"
+#endif
+
+// default number of branches to warm the predictor up on before each
+// simulation point
+
+#define DEFAULT_WARMUP	500000
+
+// where a branch lies relative to the simulation points
+
+#define PHASE_SKIP	0	// not near a point; don't run the predictor
+#define PHASE_WARM	1	// warming up; run the predictor but don't count
+#define PHASE_MEASURE	2	// in a point, or no points; run and count
+
+void usage (char *prog) {
+	fprintf (stderr, "Usage: %s [options] <filename>.gz\n", prog);
+	fprintf (stderr, "  -p small|thp|huge\tpages backing predictor tables (default thp)\n");
+	fprintf (stderr, "  -l\t\t\tmlock and prefault predictor tables\n");
+	fprintf (stderr, "  -m\t\t\treport bytes used by each table on stderr\n");
+	fprintf (stderr, "  -v\t\t\tprint branch and predictor statistics before the MPKI\n");
+	fprintf (stderr, "  -n N\t\t\tstop after the first N branches\n");
+	fprintf (stderr, "  -G file\t\trecord golden results to file\n");
+	fprintf (stderr, "  -V file\t\tcheck the run against golden results in file\n");
+	fprintf (stderr, "  -c N\t\t\tbranches between golden checkpoints (default %d)\n", GOLDEN_INTERVAL);
+	fprintf (stderr, "  -F N\t\t\trecord golden checkpoints only after the first N branches\n");
+	fprintf (stderr, "  -s file\t\tstream interval statistics to file as CSV\n");
+	fprintf (stderr, "  -b\t\t\twrite interval statistics in binary instead\n");
+	fprintf (stderr, "  -i N\t\t\tbranches per statistics interval (default %d)\n", INTERVAL_BRANCHES);
+	fprintf (stderr, "  -P file\t\tsimulate only the simulation points in file and extrapolate\n");
+	fprintf (stderr, "  -w N\t\t\tbranches of warm-up before each point (default %d)\n", DEFAULT_WARMUP);
+	exit (1);
+}
+
+// push a snapshot of the statistics so far to the interval stream
+
+void snapshot (branch_predictor *p, long long int branches,
+	long long int conditional, long long int dmiss, long long int tmiss) {
+	interval_sample s;
+	s.branches = branches;
+	s.conditional = conditional;
+	s.dmiss = dmiss;
+	s.tmiss = tmiss;
+	p->stats (s.ps);
+	interval_sample_push (s);
+}
 
 int main (int argc, char *argv[]) {
+	int opt;
+	bool report_tables = false, verbose = false;
+	long long int max_branches = -1;
+	long long int checkpoint = GOLDEN_INTERVAL, checkpoint_from = 0;
+	char *record_golden = NULL, *verify_golden = NULL;
+	char *interval_file = NULL;
+	bool interval_binary = false;
+	long long int interval = INTERVAL_BRANCHES;
+	char *points_file = NULL;
+	long long int warmup = DEFAULT_WARMUP;
 
-	// make sure there is one parameter
+	// read the options
 
-	if (argc != 2) {
-		fprintf (stderr, "Usage: %s <filename>.gz\n", argv[0]);
-		exit (1);
+	while ((opt = getopt (argc, argv, "p:lmvn:G:V:c:F:s:bi:P:w:")) != -1) {
+		switch (opt) {
+		case 'p':
+			if (strcmp (optarg, "small") == 0)
+				table_config.pages = TABLE_PAGES_SMALL;
+			else if (strcmp (optarg, "thp") == 0)
+				table_config.pages = TABLE_PAGES_THP;
+			else if (strcmp (optarg, "huge") == 0)
+				table_config.pages = TABLE_PAGES_HUGETLB;
+			else
+				usage (argv[0]);
+			break;
+		case 'l':
+			table_config.lock = true;
+			break;
+		case 'm':
+			report_tables = true;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		case 'n':
+			max_branches = atoll (optarg);
+			break;
+		case 'G':
+			record_golden = optarg;
+			break;
+		case 'V':
+			verify_golden = optarg;
+			break;
+		case 'c':
+			checkpoint = atoll (optarg);
+			if (checkpoint <= 0) usage (argv[0]);
+			break;
+		case 'F':
+			checkpoint_from = atoll (optarg);
+			if (checkpoint_from < 0) usage (argv[0]);
+			break;
+		case 's':
+			interval_file = optarg;
+			break;
+		case 'b':
+			interval_binary = true;
+			break;
+		case 'i':
+			interval = atoll (optarg);
+			if (interval <= 0) usage (argv[0]);
+			break;
+		case 'P':
+			points_file = optarg;
+			break;
+		case 'w':
+			warmup = atoll (optarg);
+			if (warmup < 0) usage (argv[0]);
+			break;
+		default:
+			usage (argv[0]);
+		}
 	}
 
+	// make sure there is one trace file
+
+	if (optind != argc - 1) usage (argv[0]);
+
+	// golden results and interval statistics need every branch
+
+	if (points_file && (record_golden || verify_golden || interval_file))
+		usage (argv[0]);
+
+	// read the simulation points, and keep mispredictions per point
+
+	static sim_points points;
+	static long long int point_branches[MAX_POINTS], point_dmiss[MAX_POINTS];
+	int point = 0;
+	if (points_file) read_points (points_file, &points);
+
 	// open the trace file for reading
 
-	init_trace (argv[1]);
+	init_trace (argv[optind]);
 
 	// initialize competitor's branch prediction code
 
 	branch_predictor *p = new my_predictor ();
+	if (report_tables) table_report (stderr);
+
+	// hash the decoded branches and the predictions if we're recording
+	// or checking golden results
+
+	bool golden = record_golden || verify_golden, diverged = false;
+	if (record_golden) golden_record (record_golden, checkpoint, checkpoint_from);
+	if (verify_golden) golden_verify (verify_golden);
 
 	// some statistics to keep, currently just for conditional branches
 
 	long long int 
 		tmiss = 0, 	// number of target mispredictions
-		dmiss = 0; 	// number of direction mispredictions
+		dmiss = 0, 	// number of direction mispredictions
+		branches = 0,	// number of branches read
+		conditional = 0;	// number of conditional branches read
+
+	// stream a snapshot of the statistics every interval branches
+
+	long long int next_sample = interval;
+	if (interval_file) interval_open (interval_file, interval, interval_binary);
 
 	// keep looping until end of file
 
 	for (;;) {
 
+		// stop early if we were asked to look at only a prefix
+
+		if (branches == max_branches) break;
+
 		// get a trace
 
 		trace *t = read_trace ();
@@ -48,6 +205,27 @@ int main (int argc, char *argv[]) {
 		// NULL means end of file
 
 		if (!t) break;
+		branches++;
+
+		// with simulation points, only run the predictor on the points
+		// and the warm-up before each one
+
+		int phase = PHASE_MEASURE;
+		if (points_file) {
+			long long int i = branches - 1;
+			while (point < points.n
+			 && i >= (points.p[point].interval + 1) * points.interval) point++;
+			phase = PHASE_SKIP;
+			if (point < points.n) {
+				long long int start = points.p[point].interval * points.interval;
+				if (i >= start)
+					phase = PHASE_MEASURE;
+				else if (i >= start - warmup)
+					phase = PHASE_WARM;
+			}
+			if (phase == PHASE_SKIP) continue;
+			if (phase == PHASE_MEASURE) point_branches[point]++;
+		}
 
 		// send this trace to the competitor's code for prediction
 
@@ -55,30 +233,82 @@ int main (int argc, char *argv[]) {
 
 		// collect statistics for a conditional branch trace
 
-		if (t->bi.br_flags & BR_CONDITIONAL) {
+		if (t->bi.br_flags & BR_CONDITIONAL && phase == PHASE_MEASURE) {
+			conditional++;
 
 			// count a direction misprediction
 
-			dmiss += u->direction_prediction () != t->taken;
+			bool miss = u->direction_prediction () != t->taken;
+			dmiss += miss;
+			if (points_file) point_dmiss[point] += miss;
 
 			// count a target misprediction
 
 			tmiss += u->target_prediction () != t->target;
 		}
 
+		// hash the branch and the prediction; stop at the first
+		// divergence from the golden results
+
+		if (golden && !golden_branch (t, u, dmiss)) {
+			diverged = true;
+			break;
+		}
+
 		// update competitor's state
 
 		p->update (u, t->taken, t->target);
+
+		// take a snapshot at the end of an interval
+
+		if (branches == next_sample && interval_file) {
+			snapshot (p, branches, conditional, dmiss, tmiss);
+			next_sample += interval;
+		}
 	}
 
 	// done reading traces
 
 	end_trace ();
 
+	// the last interval is usually a short one
+
+	if (interval_file) {
+		if (branches != next_sample - interval) {
+			snapshot (p, branches, conditional, dmiss, tmiss);
+		}
+		interval_close ();
+	}
+
 	// give final mispredictions per kilo-instruction and exit.
 	// each trace represents exactly 100 million instructions.
 
-	printf ("%0.3f MPKI\n", 1000.0 * (dmiss / 1e8));
+	double mpki = 1000.0 * (dmiss / 1e8);
+
+	// with simulation points, extrapolate from each point's mispredictions
+	// per branch, weighted, to all the branches in the trace
+
+	if (points_file) {
+		double rate = 0;
+		for (int i=0; i<points.n; i++)
+			if (point_branches[i])
+				rate += points.p[i].weight * point_dmiss[i] / point_branches[i];
+		mpki = 1000.0 * (rate * branches / 1e8);
+	}
+	bool ok = true;
+	if (golden) ok = !diverged && golden_finish (dmiss, mpki);
+	if (verbose) {
+		predictor_stats ps;
+		p->stats (ps);
+		printf ("branches: %lld\n", branches);
+		printf ("conditional branches: %lld\n", conditional);
+		printf ("direction mispredictions: %lld\n", dmiss);
+		printf ("training events: %llu\n", ps.training);
+		printf ("weak predictions: %llu\n", ps.weak);
+		printf ("strong predictions: %llu\n", ps.strong);
+		printf ("allocations: %llu\n", ps.allocations);
+	}
+	printf ("%0.3f MPKI\n", mpki);
 	delete p;
-	exit (0);
+	exit (ok ? 0 : 1);
 }
@@ -16,9 +16,25 @@ public:
 		_direction_prediction(false), _target_prediction(0) {}
 };
 
+// running counters a predictor can report for interval statistics.
+// a predictor fills in the ones that mean something for it and leaves
+// the rest at zero.
+
+struct predictor_stats {
+	unsigned long long int
+		training,	// training events
+		weak,		// low-confidence predictions
+		strong,		// high-confidence predictions
+		allocations;	// entries allocated in tagged tables
+
+	predictor_stats (void) :
+		training(0), weak(0), strong(0), allocations(0) {}
+};
+
 class branch_predictor {
 public:
 	virtual branch_update *predict (branch_info &) = 0;
 	virtual void update (branch_update *, bool, unsigned int) {}
+	virtual void stats (predictor_stats &) {}
 	virtual ~branch_predictor (void) {}
 };
@@ -0,0 +1,262 @@
+// simpoint.cc
+// This file contains the main function for simpoint, which picks a few
+// representative intervals of a trace so predict can simulate just those
+// and extrapolate the MPKI of the whole trace (see predict -P).
+//
+// It reads the trace once and, for each interval of a fixed number of
+// branches, builds a vector of how much code each static branch ended,
+// the same idea as SimPoint's basic block vectors.  A basic block ends at
+// a branch, so the branch address names the block, and its size in bytes
+// is estimated from the previous branch's target.  The vectors are
+// normalized, randomly projected down to a few dimensions and clustered
+// with k-means; the interval closest to each cluster's centroid becomes a
+// simulation point, weighted by the share of the trace's branches in its
+// cluster.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <float.h>
+#include <vector>
+#include <algorithm>
+
+#include "branch.h"
+#include "trace.h"
+#include "points.h"
+
+// defaults; SimPoint itself projects to 15 dimensions
+
+#define DEFAULT_INTERVAL	100000
+#define DEFAULT_CLUSTERS	10
+#define DEFAULT_DIMS		15
+#define RESTARTS		5
+#define MAX_ITERATIONS		100
+
+// blocks longer than this are more likely a discontinuity in the trace
+// than real straight-line code; count them as a single byte
+
+#define MAX_BLOCK		4096
+
+// a small, fast pseudo-random number generator; we need repeatable
+// results more than good ones
+
+static unsigned long long mix (unsigned long long x) {
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+static unsigned long long seed = 1;
+
+static double uniform (void) {
+	seed = mix (seed);
+	return (seed >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// the random projection of a branch address onto dimension d, in [-1, 1)
+
+static double project (unsigned int address, int d) {
+	return (mix (((unsigned long long) address << 8) | d) >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+}
+
+// squared distance between two vectors
+
+static double distance (const double *a, const double *b, int dims) {
+	double s = 0;
+	for (int d=0; d<dims; d++) s += (a[d] - b[d]) * (a[d] - b[d]);
+	return s;
+}
+
+// cluster n vectors of dims dimensions into k clusters with k-means, using
+// k-means++ to pick the starting centroids.  fills in the cluster of each
+// vector and the centroids, and returns the sum of squared distances.
+
+static double kmeans (const std::vector<double> &v, int n, int dims, int k,
+	std::vector<int> &cluster, std::vector<double> &centroid) {
+	std::vector<double> nearest (n);
+
+	// k-means++: each new centroid is a vector chosen with probability
+	// proportional to its squared distance from the nearest one so far
+
+	int first = (int) (uniform () * n);
+	memcpy (&centroid[0], &v[first * dims], dims * sizeof (double));
+	for (int i=0; i<n; i++)
+		nearest[i] = distance (&v[i * dims], &centroid[0], dims);
+	for (int c=1; c<k; c++) {
+		double total = 0;
+		for (int i=0; i<n; i++) total += nearest[i];
+		double r = uniform () * total;
+		int pick = n - 1;
+		for (int i=0; i<n; i++) {
+			r -= nearest[i];
+			if (r < 0) {
+				pick = i;
+				break;
+			}
+		}
+		memcpy (&centroid[c * dims], &v[pick * dims], dims * sizeof (double));
+		for (int i=0; i<n; i++) {
+			double dist = distance (&v[i * dims], &centroid[c * dims], dims);
+			if (dist < nearest[i]) nearest[i] = dist;
+		}
+	}
+
+	// Lloyd's algorithm until no vector changes cluster
+
+	std::vector<int> count (k);
+	double sse = 0;
+	for (int it=0; it<MAX_ITERATIONS; it++) {
+		bool changed = false;
+		sse = 0;
+		for (int i=0; i<n; i++) {
+			int best = 0;
+			double bestd = DBL_MAX;
+			for (int c=0; c<k; c++) {
+				double dist = distance (&v[i * dims], &centroid[c * dims], dims);
+				if (dist < bestd) {
+					bestd = dist;
+					best = c;
+				}
+			}
+			if (cluster[i] != best) changed = true;
+			cluster[i] = best;
+			sse += bestd;
+		}
+		if (!changed) break;
+		std::fill (centroid.begin (), centroid.end (), 0.0);
+		std::fill (count.begin (), count.end (), 0);
+		for (int i=0; i<n; i++) {
+			count[cluster[i]]++;
+			for (int d=0; d<dims; d++)
+				centroid[cluster[i] * dims + d] += v[i * dims + d];
+		}
+		for (int c=0; c<k; c++)
+			for (int d=0; d<dims; d++)
+				if (count[c]) centroid[c * dims + d] /= count[c];
+	}
+	return sse;
+}
+
+void usage (char *prog) {
+	fprintf (stderr, "Usage: %s [options] <filename>.gz\n", prog);
+	fprintf (stderr, "  -i N\tbranches per interval (default %d)\n", DEFAULT_INTERVAL);
+	fprintf (stderr, "  -k N\tnumber of clusters, i.e. simulation points (default %d, at most %d)\n", DEFAULT_CLUSTERS, MAX_POINTS);
+	fprintf (stderr, "  -d N\tdimensions to project to (default %d)\n", DEFAULT_DIMS);
+	fprintf (stderr, "  -s N\trandom seed (default 1)\n");
+	fprintf (stderr, "The simulation points are written to standard output.\n");
+	exit (1);
+}
+
+int main (int argc, char *argv[]) {
+	int opt;
+	long long int interval = DEFAULT_INTERVAL;
+	int k = DEFAULT_CLUSTERS, dims = DEFAULT_DIMS;
+
+	while ((opt = getopt (argc, argv, "i:k:d:s:")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval = atoll (optarg);
+			break;
+		case 'k':
+			k = atoi (optarg);
+			break;
+		case 'd':
+			dims = atoi (optarg);
+			break;
+		case 's':
+			seed = strtoull (optarg, NULL, 0);
+			break;
+		default:
+			usage (argv[0]);
+		}
+	}
+	if (optind != argc - 1 || interval <= 0 || k <= 0 || k > MAX_POINTS || dims <= 0)
+		usage (argv[0]);
+
+	// read the trace, accumulating one projected vector per interval
+
+	init_trace (argv[optind]);
+	std::vector<double> v;		// n vectors of dims doubles
+	std::vector<long long int> size;	// branches in each interval
+	std::vector<double> sum (dims);
+	double weight = 0;
+	long long int branches = 0;
+	unsigned int last_target = 0;
+	for (;;) {
+		trace *t = read_trace ();
+		if (t) {
+			unsigned int block = t->bi.address - last_target;
+			if (block == 0 || block > MAX_BLOCK) block = 1;
+			for (int d=0; d<dims; d++)
+				sum[d] += block * project (t->bi.address, d);
+			weight += block;
+			last_target = t->target;
+			branches++;
+		}
+
+		// close an interval at every interval branches and at the end
+
+		if ((t && branches % interval == 0) || (!t && branches % interval)) {
+			for (int d=0; d<dims; d++) {
+				v.push_back (sum[d] / weight);
+				sum[d] = 0;
+			}
+			size.push_back ((branches - 1) % interval + 1);
+			weight = 0;
+		}
+		if (!t) break;
+	}
+	end_trace ();
+	int n = size.size ();
+	if (n == 0) {
+		fprintf (stderr, "%s: empty trace\n", argv[optind]);
+		exit (1);
+	}
+	if (k > n) k = n;
+
+	// cluster, keeping the best of a few restarts
+
+	std::vector<int> cluster (n, -1), best_cluster;
+	std::vector<double> centroid (k * dims), best_centroid;
+	double best_sse = DBL_MAX;
+	for (int r=0; r<RESTARTS; r++) {
+		std::fill (cluster.begin (), cluster.end (), -1);
+		double sse = kmeans (v, n, dims, k, cluster, centroid);
+		if (sse < best_sse) {
+			best_sse = sse;
+			best_cluster = cluster;
+			best_centroid = centroid;
+		}
+	}
+
+	// pick the interval nearest each centroid and weight it by the
+	// branches in its cluster
+
+	static sim_points s;
+	s.interval = interval;
+	s.branches = branches;
+	s.n = 0;
+	for (int c=0; c<k; c++) {
+		int pick = -1;
+		double pickd = DBL_MAX;
+		long long int members = 0;
+		for (int i=0; i<n; i++) {
+			if (best_cluster[i] != c) continue;
+			members += size[i];
+			double dist = distance (&v[i * dims], &best_centroid[c * dims], dims);
+			if (dist < pickd) {
+				pickd = dist;
+				pick = i;
+			}
+		}
+		if (pick < 0) continue;
+		s.p[s.n].interval = pick;
+		s.p[s.n].weight = (double) members / branches;
+		s.n++;
+	}
+	printf ("# %d simulation points for %s\n", s.n, argv[optind]);
+	write_points (stdout, &s);
+	exit (0);
+}
@@ -0,0 +1,157 @@
+// table.cc
+// This file contains the code that allocates storage for predictor tables
+// and keeps track of it so the bytes used by each table can be reported.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "table.h"
+
+// the allocation policy; transparent huge pages unless told otherwise
+
+table_policy table_config = { TABLE_PAGES_THP, false };
+
+// tables smaller than this aren't worth a huge page of their own
+
+#define HUGE_MIN	(TABLE_HUGE_PAGE / 2)
+
+// one record per live table
+
+#define MAX_TABLES	64
+
+struct table_record {
+	const char *name;
+	char	*mapping;	// start of the mmap'd region
+	char	*data;		// start of the table within it
+	size_t	bytes,		// bytes the predictor asked for
+		maplen;		// bytes actually mapped
+	int	pages;		// TABLE_PAGES_* we ended up with
+	bool	locked;		// true if mlock succeeded
+};
+
+static table_record tables[MAX_TABLES];
+static int ntables = 0;
+
+// round n up to a multiple of a, a power of two
+
+static size_t round_up (size_t n, size_t a) {
+	return (n + a - 1) & ~(a - 1);
+}
+
+// map len bytes of zero-filled memory aligned to align, or NULL.
+// the whole region from *mapping to *mapping+*maplen must be unmapped later.
+
+static char *map_aligned (size_t len, size_t align, int flags, char **mapping, size_t *maplen) {
+	size_t total = len + align;
+	char *p = (char *) mmap (NULL, total, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+	if (p == MAP_FAILED) return NULL;
+
+	// give back the slop on either side of the aligned region
+
+	char *a = (char *) round_up ((size_t) p, align);
+	if (a > p) munmap (p, a - p);
+	if (a + len < p + total) munmap (a + len, (p + total) - (a + len));
+	*mapping = a;
+	*maplen = len;
+	return a;
+}
+
+// touch every page of a region so the page faults happen now rather than
+// during the first pass over the trace
+
+static void prefault (char *p, size_t len) {
+	size_t page = sysconf (_SC_PAGESIZE);
+	for (size_t i=0; i<len; i+=page)
+		((volatile char *) p)[i] = 0;
+}
+
+// allocate a zero-filled table of the given size according to table_config
+
+void *table_alloc (const char *name, size_t bytes) {
+	if (ntables == MAX_TABLES) {
+		fprintf (stderr, "too many predictor tables (max %d)\n", MAX_TABLES);
+		exit (1);
+	}
+	table_record *r = &tables[ntables];
+	r->name = name;
+	r->bytes = bytes;
+	r->data = NULL;
+	r->locked = false;
+	r->pages = table_config.pages;
+	if (bytes < HUGE_MIN) r->pages = TABLE_PAGES_SMALL;
+
+	// explicit huge pages come out of a pool the administrator has to
+	// reserve (vm.nr_hugepages); if it's empty, fall back to THP
+
+	if (r->pages == TABLE_PAGES_HUGETLB) {
+		r->maplen = round_up (bytes, TABLE_HUGE_PAGE);
+		r->mapping = (char *) mmap (NULL, r->maplen, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (r->mapping != MAP_FAILED) {
+			r->data = r->mapping;
+		} else {
+			static bool warned = false;
+			if (!warned) {
+				perror ("MAP_HUGETLB (falling back to transparent huge pages)");
+				warned = true;
+			}
+			r->pages = TABLE_PAGES_THP;
+		}
+	}
+	if (r->pages == TABLE_PAGES_THP) {
+		r->data = map_aligned (round_up (bytes, TABLE_HUGE_PAGE),
+			TABLE_HUGE_PAGE, 0, &r->mapping, &r->maplen);
+		if (r->data) madvise (r->mapping, r->maplen, MADV_HUGEPAGE);
+	}
+	if (!r->data) {
+		r->pages = TABLE_PAGES_SMALL;
+		r->data = map_aligned (round_up (bytes, sysconf (_SC_PAGESIZE)),
+			TABLE_ALIGN, 0, &r->mapping, &r->maplen);
+	}
+	if (!r->data) {
+		perror (name);
+		exit (1);
+	}
+
+	// mlock faults the pages in as well as pinning them; if we're over
+	// RLIMIT_MEMLOCK just touch them instead
+
+	if (table_config.lock) {
+		r->locked = mlock (r->mapping, r->maplen) == 0;
+		if (!r->locked) prefault (r->mapping, r->maplen);
+	}
+	ntables++;
+	return r->data;
+}
+
+// release a table allocated with table_alloc
+
+void table_free (void *p, size_t bytes) {
+	for (int i=0; i<ntables; i++) {
+		if (tables[i].data == p) {
+			munmap (tables[i].mapping, tables[i].maplen);
+			tables[i] = tables[--ntables];
+			return;
+		}
+	}
+}
+
+// print the bytes used by each live table
+
+void table_report (FILE *f) {
+	static const char *kinds[] = { "small pages", "transparent huge pages", "huge pages" };
+	size_t total = 0, mapped = 0;
+	for (int i=0; i<ntables; i++) {
+		table_record *r = &tables[i];
+		fprintf (f, "table %-16s %10zu bytes (%zu mapped, %s%s)\n",
+			r->name, r->bytes, r->maplen, kinds[r->pages],
+			r->locked ? ", locked" : "");
+		total += r->bytes;
+		mapped += r->maplen;
+	}
+	fprintf (f, "table %-16s %10zu bytes (%zu mapped)\n", "total", total, mapped);
+}
@@ -0,0 +1,63 @@
+// table.h
+// This file declares the predictor_table class and the functions that
+// allocate storage for it.  Predictor tables are allocated with mmap
+// rather than as members of my_predictor, so every table starts on a
+// cache line (in fact a page) boundary and large tables can be backed by
+// huge pages, which cuts down on TLB misses for the scattered lookups
+// predictors do.  Storage is always zero-filled, so predictors don't
+// need to memset their tables.
+
+// cache line size; every table starts on at least this boundary
+
+#define TABLE_ALIGN		64
+
+// huge page size assumed for transparent and explicit huge pages
+
+#define TABLE_HUGE_PAGE		(2 * 1024 * 1024)
+
+// how the pages behind a table are allocated
+
+#define TABLE_PAGES_SMALL	0	// ordinary pages
+#define TABLE_PAGES_THP		1	// transparent huge pages via madvise
+#define TABLE_PAGES_HUGETLB	2	// explicit huge pages via MAP_HUGETLB
+
+// the allocation policy.  predict.cc fills this in from the command line
+// before the predictor is constructed.
+
+struct table_policy {
+	int	pages;	// one of TABLE_PAGES_*
+	bool	lock;	// mlock and prefault tables when they are allocated
+};
+
+extern table_policy table_config;
+
+void *table_alloc (const char *, size_t);
+void table_free (void *, size_t);
+void table_report (FILE *);
+
+// an array of n entries of type T.  T may itself be an array type, so a
+// table of rows can still be indexed as t[row][column].
+
+template <class T> class predictor_table {
+	T *_data;
+	size_t _entries;
+
+	// tables own their mapping, so they can't be copied
+
+	predictor_table (const predictor_table &);
+	predictor_table & operator = (const predictor_table &);
+
+public:
+	predictor_table (const char *name, size_t n) : _entries(n) {
+		_data = (T *) table_alloc (name, n * sizeof (T));
+	}
+
+	~predictor_table (void) { table_free (_data, bytes ()); }
+
+	T & operator [] (size_t i) { return _data[i]; }
+	const T & operator [] (size_t i) const { return _data[i]; }
+
+	T *data (void) { return _data; }
+	size_t entries (void) const { return _entries; }
+	size_t bytes (void) const { return _entries * sizeof (T); }
+};
@@ -2,7 +2,7 @@
 """
 analyze_results.py
 
-Parses procsim output files in ./outputs, computes IPC, generates plots
+Parses procsim results in ./outputs, computes IPC, generates plots
 (IPC vs each parameter) with a fixed baseline, and selects the minimal
 hardware configuration (k0+k1+k2+R) achieving ≥95% of max IPC per trace & F.
 
@@ -61,7 +61,14 @@ def parse_output_file(path):
     return params
 
 def load_data(output_dir):
-    """Load all .out files into a pandas DataFrame."""
+    """
+    Load the results into a pandas DataFrame: the CSV written by
+    procsim -S (see run_experiments.py) if there is one, else all .out files.
+    """
+    sweep_csv = os.path.join(output_dir, "sweep.csv")
+    if os.path.exists(sweep_csv):
+        df = pd.read_csv(sweep_csv)
+        return df[['trace', 'k0', 'k1', 'k2', 'R', 'F', 'IPC']]
     records = []
     for filepath in glob.glob(os.path.join(output_dir, "*.out")):
         rec = parse_output_file(filepath)
@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""
+benchmark.py
+
+Measures how fast procsim simulates, rather than what it simulates: for
+each bundled trace, and a synthetically extended copy of it, over a grid
+of window (RS) sizes and fetch widths, the simulated instructions per
+second and the peak resident set size of the procsim process, as procsim
+reports them on stderr when given -M.  Results are written as JSON, so runs can be
+compared as the simulator changes.
+
+The RS holds 2*(k0+k1+k2) instructions, so the window grid is given as
+the number of FUs of each type: 1 is the assignment's smallest machine
+and 512 a window of 3072 entries.
+
+Usage:
+  $ python3 benchmark.py [-p ./procsim] [-o benchmark.json]
+  $ python3 benchmark.py --fus 1,16 --fetch 4 --scale 2    # a quick run
+"""
+
+import argparse
+import json
+import os
+import platform
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+TRACES_DIR = "./traces"
+TRACES = ["gcc", "gobmk", "hmmer", "mcf"]
+
+
+def values(text):
+    return [int(v) for v in text.split(",")]
+
+
+def extend_trace(path, scale, out_dir):
+    """
+    A trace scale times as long as the one at path: it repeated scale
+    times.  Simulation speed depends on the instruction mix and the
+    dependences between instructions, which repeating keeps.
+    """
+    with open(path) as f:
+        lines = f.read()
+    if not lines.endswith("\n"):
+        lines += "\n"
+    name = os.path.basename(path).replace(".trace", f".x{scale}.trace")
+    out_path = os.path.join(out_dir, name)
+    with open(out_path, "w") as f:
+        for _ in range(scale):
+            f.write(lines)
+    return out_path
+
+
+def run_once(procsim, trace, fus, fetch, buses):
+    """
+    Runs one simulation with no timeline, returning the seconds procsim
+    took from reading the trace to the end, its wall time as a process,
+    its peak RSS, and the instructions and IPC it reports.  The peak comes
+    from procsim rather than rusage, which on Linux counts what this
+    script had resident when it started procsim.
+    """
+    cmd = [procsim, "-t", "none", "-M", "-r", str(buses), "-j", str(fus),
+           "-k", str(fus), "-l", str(fus), "-f", str(fetch), "-i", trace]
+    start = time.perf_counter()
+    proc = subprocess.run(cmd, capture_output=True, text=True, check=True)
+    wall = time.perf_counter() - start
+    instructions = int(re.search(r"Total instructions: (\d+)", proc.stdout).group(1))
+    ipc = float(re.search(r"Avg inst retired per cycle: ([\d.]+)", proc.stdout).group(1))
+    speed = re.search(r"instructions in ([\d.]+) s .*peak RSS (-?\d+) KB", proc.stderr)
+    return float(speed.group(1)), wall, int(speed.group(2)), instructions, ipc
+
+
+def main():
+    parser = argparse.ArgumentParser(description="procsim simulation speed benchmark")
+    parser.add_argument("-p", "--procsim", default="./procsim", help="simulator to measure")
+    parser.add_argument("-o", "--output", default="-", help="JSON results (default stdout)")
+    parser.add_argument("--fus", type=values, default=[1, 2, 16, 128, 512],
+                        help="FUs of each type, giving RS sizes of 6x these")
+    parser.add_argument("--fetch", type=values, default=[4, 8, 16], help="fetch widths")
+    parser.add_argument("-r", "--buses", type=int, default=8, help="result buses")
+    parser.add_argument("--scale", type=int, default=10,
+                        help="how many times longer the extended traces are (1 for none)")
+    parser.add_argument("--repeat", type=int, default=1,
+                        help="runs of each configuration, keeping the fastest")
+    args = parser.parse_args()
+
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        traces = []
+        for name in TRACES:
+            path = os.path.join(TRACES_DIR, f"{name}.100k.trace")
+            traces.append(path)
+            if args.scale > 1:
+                traces.append(extend_trace(path, args.scale, tmp))
+
+        for trace in traces:
+            for fus in args.fus:
+                for fetch in args.fetch:
+                    runs = [run_once(args.procsim, trace, fus, fetch, args.buses)
+                            for _ in range(args.repeat)]
+                    seconds, wall, _, instructions, ipc = min(runs)
+                    rss_kb = max(run[2] for run in runs)
+                    results.append({
+                        "trace": os.path.basename(trace),
+                        "instructions": instructions,
+                        "k": fus,
+                        "rs_size": 2 * 3 * fus,
+                        "fetch": fetch,
+                        "buses": args.buses,
+                        "ipc": ipc,
+                        "seconds": round(seconds, 4),
+                        "wall_seconds": round(wall, 4),
+                        "instructions_per_second": round(instructions / seconds),
+                        "peak_rss_kb": rss_kb,
+                    })
+                    print(f"{results[-1]['trace']:24} RS {2 * 3 * fus:5} F {fetch:2}: "
+                          f"{instructions / seconds / 1000:9.1f} KIPS, {rss_kb} KB",
+                          file=sys.stderr)
+
+    report = {
+        "procsim": os.path.abspath(args.procsim),
+        "host": platform.node(),
+        "machine": platform.machine(),
+        "runs": results,
+    }
+    if args.output == "-":
+        print(json.dumps(report, indent=2))
+    else:
+        with open(args.output, "w") as f:
+            json.dump(report, f, indent=2)
+            f.write("\n")
+
+
+if __name__ == "__main__":
+    main()
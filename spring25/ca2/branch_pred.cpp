@@ -0,0 +1,96 @@
+// branch_pred.cpp
+#include "branch_pred.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include "table.h"
+
+// The ca1 predictor to build in; the Makefile picks one with PREDICTOR.
+// Its statistics file is for predict's one predictor a run; procsim makes
+// one per configuration or sample, on several threads, so it's left out.
+#define NO_PREDICTOR_STATS
+#ifdef PREDICTOR
+#include PREDICTOR
+#else
+#include "my_predictor.h"
+#endif
+
+namespace
+{
+        // The same guess for every branch
+        class StaticPredictor : public branch_predictor
+        {
+        public:
+                explicit StaticPredictor(bool taken)
+                {
+                        u.direction_prediction(taken);
+                }
+                branch_update *predict(branch_info &) override
+                {
+                        return &u;
+                }
+
+        private:
+                branch_update u;
+        };
+
+        // ca1's table allocator keeps one list of tables for the whole
+        // process, so predictors on different sweep threads take turns
+        // making and freeing theirs
+        std::mutex tableLock;
+
+        class CbpPredictor : public branch_predictor
+        {
+        public:
+                CbpPredictor()
+                {
+                        std::lock_guard<std::mutex> lock(tableLock);
+                        p = new my_predictor();
+                }
+                ~CbpPredictor()
+                {
+                        std::lock_guard<std::mutex> lock(tableLock);
+                        delete p;
+                }
+                branch_update *predict(branch_info &b) override
+                {
+                        return p->predict(b);
+                }
+                void update(branch_update *u, bool taken, unsigned int target) override
+                {
+                        p->update(u, taken, target);
+                }
+
+        private:
+                my_predictor *p;
+        };
+} // end anonymous namespace
+
+branch_predictor *make_branch_predictor(BranchPredictorKind kind)
+{
+        switch (kind)
+        {
+        case BP_TAKEN:
+                return new StaticPredictor(true);
+        case BP_NOT_TAKEN:
+                return new StaticPredictor(false);
+        case BP_CBP:
+                return new CbpPredictor();
+        default:
+                return nullptr;
+        }
+}
+
+bool predict_branch(branch_predictor *predictor, unsigned int pc, unsigned int next_pc)
+{
+        branch_info info;
+        info.address = pc;
+        info.opcode = 0;
+        info.br_flags = BR_CONDITIONAL;
+        bool taken = next_pc != pc + 4;
+        auto u = predictor->predict(info);
+        bool predicted = u->direction_prediction();
+        predictor->update(u, taken, next_pc);
+        return predicted == taken;
+}
@@ -0,0 +1,37 @@
+// branch_pred.hpp
+#ifndef BRANCH_PRED_HPP
+#define BRANCH_PRED_HPP
+
+// The CBP-2 predictor interface from ca1.  Those headers have no include
+// guards, so procsim only ever includes them from here.
+#include "branch.h"
+#include "predictor.h"
+
+// Which predictor fetch consults about the branches in the trace
+enum BranchPredictorKind
+{
+    BP_PERFECT = 0, // every branch predicted right, as the assignment assumes
+    BP_TAKEN,       // always taken
+    BP_NOT_TAKEN,   // always not taken
+    BP_CBP          // the ca1 predictor procsim was built with (PREDICTOR)
+};
+
+// What fetch does about a mispredicted branch
+enum BranchRecovery
+{
+    RECOVER_REDIRECT = 0, // waits for the branch to write back, then the penalty
+    RECOVER_STALL         // stalls for the penalty right after fetching it
+};
+
+// A new predictor of the given kind; nullptr for BP_PERFECT
+branch_predictor *make_branch_predictor(BranchPredictorKind kind);
+
+// Predicts the branch at pc and trains predictor with where it went,
+// next_pc; true if it was predicted right.  Instructions are four bytes,
+// so the branch was taken if next_pc doesn't follow it.  The traces don't
+// say which branches are conditional or where an indirect one was
+// predicted to go, so every branch is treated as a conditional one whose
+// target is always known.
+bool predict_branch(branch_predictor *predictor, unsigned int pc, unsigned int next_pc);
+
+#endif // BRANCH_PRED_HPP
@@ -6,291 +6,830 @@
 #include <cstdlib>
 #include <cstring>
 #include <algorithm>
+#include <climits>
+#include <functional>
+#include <memory>
+#include <chrono>
 
-namespace
+bool TraceBufferSource::next(proc_inst_t *p_inst)
 {
-        // Maximum number of instructions we can handle
-        constexpr int MAX_INSTRUCTIONS = 100000;
-
-        // Current size of the dispatch queue (waiting to be scheduled)
-        unsigned long currentDispatchQueueSize = 0;
-        // Largest we ever saw the dispatch queue get
-        unsigned long maximumDispatchQueueSize = 0;
-        // Running sum of dispatch queue sizes (for average)
-        unsigned long totalDispatchQueueSizeSum = 0;
-
-        // Records timing stages for each retired instruction
-        int instructionTimeline[MAX_INSTRUCTIONS][6];
-
-        // Next unique tag assigned to a fetched instruction
-        int nextInstructionTag = 0;
-
-        // Available resources in the pipeline
-        int robCapacity = 0;           // total result buses / ROB entries
-        int robAvailable = 0;          // how many remain free
-        int fuCapacity[3] = {0};       // total FUs per op code
-        int fuAvailableUnits[3] = {0}; // how many FUs of each type are free
-        int fetchWidth = 0;            // instructions fetched per cycle
-        int scheduleQueueSize = 0;     // size of schedule queue (2×FUs)
-        int freeReservationSlots = 0;  // how many RS entries remain
-
-        int cycleCount = 1; // simulation cycle, starts at 1
-
-        // Pools and register file state
-        Function_Unit fuPool[3];
-        Register_File registerFile[129]; // entry 128 acts as “dummy reg”
-
-        // Active instructions in flight
-        std::vector<_proc_inst_t *> pipelineInstQueue;
-        using InstIt = std::vector<_proc_inst_t *>::iterator;
-
-        // Fetches a new instruction from stdin and sets up its tags and timing
-        _proc_inst_t *fetchNextInstruction()
-        {
-                auto inst = new _proc_inst_t();
-                int ret = fscanf(stdin, "%x %d %d %d %d",
-                                 &inst->instruction_address,
-                                 &inst->op_code,
-                                 &inst->dest_reg,
-                                 &inst->src_reg[0],
-                                 &inst->src_reg[1]);
-                // Hit EOF or bad line?
-                if (ret != 5)
+        if (pos == records.size())
+                return false;
+        const trace_record_t &rec = records[pos++];
+        p_inst->instruction_address = rec.instruction_address;
+        p_inst->op_code = rec.op_code;
+        p_inst->dest_reg = rec.dest_reg;
+        p_inst->src_reg[0] = rec.src_reg[0];
+        p_inst->src_reg[1] = rec.src_reg[1];
+        return true;
+}
+
+// Fetches a new instruction from the trace and sets up its tags and
+// timing; nullptr at the end of the trace, or while fetch waits for a
+// mispredicted branch to resolve
+_proc_inst_t *Processor::fetchNextInstruction()
+{
+        for (;;)
+        {
+                // Each fetch cycle belongs to one thread
+                if (fetchSlot == 0 && !pickFetchThread())
+                        return nullptr;
+                auto &thread = threads[fetchThread];
+                if (waitingOnBranch(thread))
+                        return nullptr;
+                auto inst = thread.heldInst;
+                if (inst != nullptr)
                 {
-                        inst->_null = true;
-                        return inst;
+                        thread.heldInst = nullptr;
+                }
+                else
+                {
+                        if (freeInsts.empty())
+                        {
+                                instPool.emplace_back();
+                                freeInsts.push_back(&instPool.back());
+                        }
+                        inst = freeInsts.back();
+                        *inst = _proc_inst_t();
+                        // Hit EOF or bad line?
+                        bool read = thread.source->next(inst);
+                        if (read)
+                                freeInsts.pop_back();
+                        if (!read || (thread.lastFetched.branch && predictor && !checkBranch(thread, inst)))
+                        {
+                                if (threads.size() == 1)
+                                        return nullptr;
+                                // The rest of this thread's fetch cycle goes unused
+                                fetchSlot = 0;
+                                ++fetchCycle;
+                                continue;
+                        }
                 }
-                inst->_null = false;
 
                 // Map invalid register (-1) to index 128
                 for (int i = 0; i < 2; i++)
                         if (inst->src_reg[i] == -1)
                                 inst->src_reg[i] = 128;
 
+                inst->latency = opLatency[inst->op_code + 1];
+                inst->interval = opInterval[inst->op_code + 1];
+
                 // Some traces use -1 opcode; normalize to 1
-                if (inst->op_code == -1)
+                bool branch = inst->op_code == -1;
+                if (branch)
                         inst->op_code = 1;
 
                 // Assign unique tag and compute fetch/dispatch cycles
+                inst->thread = fetchThread;
                 inst->dest_tag = nextInstructionTag;
-                inst->fet_cyc = 1 + nextInstructionTag / fetchWidth;
+                inst->fet_cyc = fetchCycle;
                 inst->disp_cyc = inst->fet_cyc + 1;
+                if (++fetchSlot == fetchWidth)
+                {
+                        fetchSlot = 0;
+                        ++fetchCycle;
+                }
+                thread.lastFetched = {inst->instruction_address, inst->dest_tag, inst->fet_cyc, branch, -1};
+                ++thread.fetched;
+                ++thread.unissued;
                 ++nextInstructionTag;
                 return inst;
         }
+}
 
-        // Update statistics for dispatch queue occupancy
-        void updateDispatchStats()
+// Picks the thread to fetch in fetchCycle: one with instructions left
+// that isn't recovering from a branch, the next in turn or the one with
+// the fewest waiting to issue.  If none can until a later cycle, fetch
+// moves on to it.  False if none can yet.
+bool Processor::pickFetchThread()
+{
+        int n = static_cast<int>(threads.size());
+        if (n == 1)
+                return true;
+        while (fetchCycle <= cycleCount)
         {
-                // Only accumulate while we’re still fetching real instructions
-                if (fetchWidth * cycleCount <= MAX_INSTRUCTIONS)
+                int best = -1;
+                int soonest = INT_MAX;
+                bool waiting = false;
+                for (int i = 1; i <= n; i++)
                 {
-                        currentDispatchQueueSize += fetchWidth;
-                        maximumDispatchQueueSize = std::max(currentDispatchQueueSize,
-                                                            maximumDispatchQueueSize);
+                        int t = (fetchThread + i) % n;
+                        auto &thread = threads[t];
+                        if (waitingOnBranch(thread))
+                                waiting = true;
+                        else if (thread.heldInst == nullptr && !thread.source->hasAtLeast(thread.fetched + 1))
+                                continue;
+                        else if (thread.resumeCycle > fetchCycle)
+                                soonest = std::min(soonest, thread.resumeCycle);
+                        else if (best == -1 || (options.fetch_policy == FETCH_ICOUNT &&
+                                                thread.unissued < threads[best].unissued))
+                                best = t;
+                }
+                if (best != -1)
+                {
+                        fetchThread = best;
+                        return true;
                 }
-                totalDispatchQueueSizeSum += currentDispatchQueueSize;
+
+                // Fetch sits idle until a thread can go on
+                bool open = !fetchBubbles.empty() && fetchBubbles.back().second == INT_MAX;
+                if (soonest == INT_MAX)
+                {
+                        if (waiting && !open)
+                                fetchBubbles.push_back({fetchCycle, INT_MAX});
+                        return false;
+                }
+                if (open)
+                        fetchBubbles.back().second = soonest;
+                else
+                        fetchBubbles.push_back({fetchCycle, soonest});
+                fetchCycle = soonest;
+        }
+        return false;
+}
+
+// True while thread can't fetch until a mispredicted branch resolves.
+// Once it has, the thread picks up again after the penalty.
+bool Processor::waitingOnBranch(Thread &thread)
+{
+        if (thread.heldInst == nullptr || thread.resumeCycle != INT_MAX)
+                return false;
+        if (thread.lastFetched.resolved == -1)
+                return true;
+        redirectFetch(thread, thread.lastFetched.resolved + options.mispredict_penalty);
+        return false;
+}
+
+// True if some thread has instructions left to fetch
+bool Processor::moreToFetch()
+{
+        for (auto &thread : threads)
+                if (thread.heldInst != nullptr || thread.source->hasAtLeast(thread.fetched + 1))
+                        return true;
+        return false;
+}
+
+// True if the threads' traces hold at least count instructions in all
+bool Processor::traceHasAtLeast(uint64_t count)
+{
+        if (threads.size() == 1)
+                return threads[0].source->hasAtLeast(count);
+        return count <= traceTotal;
+}
+
+// Predicts the branch thread fetched last, now that next shows which way
+// it went, and steers fetch if the prediction was wrong.  False if next
+// has to wait for the thread to fetch again.
+bool Processor::checkBranch(Thread &thread, _proc_inst_t *next)
+{
+        auto &branch = thread.lastFetched;
+        ++branches.branches;
+        if (predict_branch(predictor, branch.pc, next->instruction_address))
+                return true;
+
+        ++branches.mispredicts;
+        if (options.branch_recovery == RECOVER_STALL)
+                redirectFetch(thread, branch.fet_cyc + 1 + options.mispredict_penalty);
+        else if (branch.resolved != -1)
+                redirectFetch(thread, branch.resolved + options.mispredict_penalty);
+        else
+        {
+                // Fetch can't go on until the branch has a result bus
+                if (threads.size() == 1)
+                        fetchBubbles.push_back({branch.fet_cyc + 1, INT_MAX});
+                thread.resumeCycle = INT_MAX;
+                thread.heldInst = next;
+                return false;
         }
 
-        // True if this instruction is now ready to leave dispatch and enter RS
-        bool isReadyForDispatch(_proc_inst_t *inst)
+        // With other threads to fetch meanwhile, this one waits its turn
+        if (threads.size() > 1)
         {
-                return inst->disp_cyc <= cycleCount && inst->sched_cyc == -1 && inst->exec_cyc == -1 && inst->stateUp_cyc == -1 && !inst->dispatched;
+                thread.heldInst = next;
+                return false;
         }
+        return true;
+}
 
-        // Fetch up to fetchWidth instructions, or until reservation slots fill
-        void fetchInstructions()
+// Start fetching the right path of thread again in cycle resume.
+// Whatever it fetched after the mispredicted branch until then was
+// thrown away.  With one thread, fetch has nothing else to do until then.
+void Processor::redirectFetch(Thread &thread, int resume)
+{
+        int first = thread.lastFetched.fet_cyc + 1;
+        branches.fetch_lost += std::max(resume - first, 0);
+        thread.resumeCycle = resume;
+        if (threads.size() > 1)
+                return;
+        if (!fetchBubbles.empty() && fetchBubbles.back().second == INT_MAX)
+                fetchBubbles.back().second = resume;
+        else if (resume > first)
+                fetchBubbles.push_back({first, resume});
+        fetchCycle = resume;
+        fetchSlot = 0;
+}
+
+// Update statistics for dispatch queue occupancy
+void Processor::updateDispatchStats()
+{
+        // Fetch brings in fetchWidth instructions a cycle, except while
+        // it's recovering from a mispredicted branch
+        while (!fetchBubbles.empty() && fetchBubbles.front().second <= cycleCount)
+                fetchBubbles.pop_front();
+        bool fetching = fetchBubbles.empty() || fetchBubbles.front().first > cycleCount;
+
+        // Only accumulate while we’re still fetching real instructions;
+        // the last fetch group holds whatever is left of the trace
+        if (fetching && !pastEndOfTrace)
         {
-                int slots = std::min(fetchWidth, freeReservationSlots);
-                for (int i = 0; i < slots; i++)
+                uint64_t fetched = static_cast<uint64_t>(fetchWidth) * fetchCycles;
+                int group = fetchWidth;
+                if (!traceHasAtLeast(fetched + fetchWidth))
+                {
+                        pastEndOfTrace = true;
+                        group = 0;
+                        while (group < fetchWidth && traceHasAtLeast(fetched + group + 1))
+                                ++group;
+                }
+                if (group > 0)
                 {
-                        auto inst = fetchNextInstruction();
-                        if (inst->_null)
-                                return; // no more instructions
-                        pipelineInstQueue.push_back(inst);
+                        ++fetchCycles;
+                        currentDispatchQueueSize += group;
+                        maximumDispatchQueueSize = std::max(currentDispatchQueueSize,
+                                                            maximumDispatchQueueSize);
                 }
         }
+        totalDispatchQueueSizeSum += currentDispatchQueueSize;
+}
 
-        // Move ready instructions into the schedule queue, allocate tags/registers
-        void dispatchInstructions()
+// Put a newly fetched instruction in the window, doubling the window
+// until the oldest instruction in flight is in it too
+void Processor::addToWindow(_proc_inst_t *inst)
+{
+        size_t size = window.size();
+        if (static_cast<size_t>(inst->dest_tag - windowBase) >= size)
         {
-                for (auto inst : pipelineInstQueue)
+                std::vector<_proc_inst_t *> grown(2 * size, nullptr);
+                for (int t = 0; t < 3; t++)
+                        issuable[t].assign(2 * size / 64, 0);
+                for (int tag = windowBase; tag < inst->dest_tag; tag++)
                 {
-                        if (isReadyForDispatch(inst) && freeReservationSlots > 0)
-                        {
-                                --currentDispatchQueueSize;
-                                --freeReservationSlots;
-
-                                // Check register file: if ready, mark src_ready; else stamp tag
-                                for (int j = 0; j < 2; j++)
-                                {
-                                        int r = inst->src_reg[j];
-                                        if (registerFile[r].ready)
-                                        {
-                                                inst->src_ready[j] = true;
-                                        }
-                                        else
-                                        {
-                                                inst->src_tag[j] = registerFile[r].tag;
-                                                inst->src_ready[j] = false;
-                                        }
-                                }
-
-                                // Allocate destination register in RF
-                                if (inst->dest_reg != -1)
-                                {
-                                        registerFile[inst->dest_reg].tag = inst->dest_tag;
-                                        registerFile[inst->dest_reg].ready = false;
-                                }
-                                else
-                                {
-                                        registerFile[128].tag = inst->dest_tag;
-                                }
-
-                                inst->dispatched = true;
-                                inst->sched_cyc = cycleCount + 1;
-                        }
+                        auto old = window[tag & (size - 1)];
+                        grown[tag & (2 * size - 1)] = old;
+                        if (old != nullptr && old->dispatched && !old->fired &&
+                            old->src_ready[0] && old->src_ready[1])
+                                issuable[old->op_code][(tag & (2 * size - 1)) / 64] |= 1ull << (tag % 64);
                 }
+                window.swap(grown);
+                addToWindow(inst);
+                return;
         }
+        window[inst->dest_tag & (size - 1)] = inst;
+        ++inFlight;
+}
+
+// An instruction in the RS now has both its sources
+void Processor::markIssuable(_proc_inst_t *inst)
+{
+        size_t slot = inst->dest_tag & (window.size() - 1);
+        issuable[inst->op_code][slot / 64] |= 1ull << (slot % 64);
+        ++issuableCount[inst->op_code];
+}
 
-        // True if instruction is in RS and hasn't fired yet
-        bool isReadyToIssue(_proc_inst_t *inst)
+// How many instructions fetch can bring in this cycle: no more than
+// there's room for in the RS.  Without a ROB, whatever was fetched
+// earlier has been dispatched unless the RS is full; with one, the ROB
+// or the physical registers can hold it up too, so leave room for it.
+int Processor::fetchRoom()
+{
+        int room = freeReservationSlots;
+        if (reorderBufferSize > 0)
+                room = std::max(room - static_cast<int>(dispatchQueue.size()), 0);
+        return std::min(fetchWidth, room);
+}
+
+// Fetch up to fetchWidth instructions, or as many as there is room for
+void Processor::fetchInstructions()
+{
+        int slots = fetchRoom();
+        for (int i = 0; i < slots; i++)
         {
-                return inst->sched_cyc <= cycleCount && !inst->fired;
+                // Still recovering from a mispredicted branch?
+                if (fetchCycle > cycleCount)
+                        return;
+                auto inst = fetchNextInstruction();
+                if (inst == nullptr)
+                        return; // no more instructions
+                addToWindow(inst);
+                dispatchQueue.push_back(inst);
         }
+        if (slots < fetchWidth && moreToFetch())
+                util.fetch_lost += fetchWidth - slots;
+}
 
-        // Issue any ready instructions into functional units
-        void issueInstructions()
+// Move ready instructions into the schedule queue, allocate tags/registers
+void Processor::dispatchInstructions()
+{
+        // Instructions are ready to dispatch in the order they were
+        // fetched, and enter the ROB in order, so once one can't, none
+        // after it can either
+        while (!dispatchQueue.empty() && dispatchQueue.front()->disp_cyc <= cycleCount)
         {
-                for (auto inst : pipelineInstQueue)
+                auto inst = dispatchQueue.front();
+                uint64_t *blocked = dispatchStall(inst);
+                if (blocked != nullptr)
                 {
-                        if (isReadyToIssue(inst) && inst->src_ready[0] && inst->src_ready[1] && fuAvailableUnits[inst->op_code] > 0)
-                        {
-                                inst->fired = true;
-                                inst->fu_busy = true;
-                                --fuAvailableUnits[inst->op_code];
-                                inst->exec_cyc = cycleCount + 1;
-                        }
+                        auto ready = std::upper_bound(dispatchQueue.begin(), dispatchQueue.end(), cycleCount,
+                                                      [](int cycle, const _proc_inst_t *i) { return cycle < i->disp_cyc; });
+                        *blocked += ready - dispatchQueue.begin();
+                        break;
                 }
-        }
 
-        // Advance execution: write back from FUs and CDBs
-        void executeInstructions()
-        {
-                // First handle instructions that have waited the longest in FUs
-                int maxWait = 0;
-                for (auto inst : pipelineInstQueue)
-                        maxWait = std::max(maxWait, inst->fu_wait);
+                dispatchQueue.pop_front();
+                if (currentDispatchQueueSize > 0)
+                        --currentDispatchQueueSize;
+                --freeReservationSlots;
+                auto &thread = threads[inst->thread];
+                auto &registerFile = thread.registerFile;
 
-                for (int w = maxWait; w > 0; --w)
+                // Check register file: if ready, mark src_ready; else stamp tag
+                for (int j = 0; j < 2; j++)
                 {
-                        for (auto inst : pipelineInstQueue)
+                        int r = inst->src_reg[j];
+                        if (registerFile[r].ready)
                         {
-                                if (inst->fu_wait == w && robAvailable > 0)
-                                {
-                                        --robAvailable;
-                                        ++fuAvailableUnits[inst->op_code];
-                                        inst->fu_busy = false;
-                                        inst->fu_wait = 0;
-                                        inst->CDB_busy = true;
-                                        inst->completed = true;
-                                        inst->stateUp_cyc = cycleCount + 1;
-                                }
+                                inst->src_ready[j] = true;
+                        }
+                        else
+                        {
+                                inst->src_tag[j] = registerFile[r].tag;
+                                inst->src_ready[j] = false;
+
+                                // Join the producer's wakeup list
+                                auto producer = registerFile[r].producer;
+                                inst->wake_next[j] = producer->wake_head;
+                                inst->wake_next_src[j] = producer->wake_head_src;
+                                producer->wake_head = inst;
+                                producer->wake_head_src = j;
                         }
                 }
 
-                // Then any instruction that has finished exec but not yet retired
-                if (robAvailable > 0)
+                // Allocate destination register in RF
+                if (inst->dest_reg != -1)
                 {
-                        for (auto inst : pipelineInstQueue)
+                        registerFile[inst->dest_reg].tag = inst->dest_tag;
+                        registerFile[inst->dest_reg].producer = inst;
+                        registerFile[inst->dest_reg].ready = false;
+                }
+                else
+                {
+                        registerFile[128].tag = inst->dest_tag;
+                }
+
+                // Rename its destination and take a ROB entry
+                if (reorderBufferSize > 0)
+                {
+                        if (inst->dest_reg != -1)
                         {
-                                if (inst->exec_cyc != -1 && inst->exec_cyc <= cycleCount && !inst->completed && robAvailable > 0)
-                                {
-                                        --robAvailable;
-                                        ++fuAvailableUnits[inst->op_code];
-                                        inst->fu_busy = false;
-                                        inst->fu_wait = 0;
-                                        inst->CDB_busy = true;
-                                        inst->completed = true;
-                                        inst->stateUp_cyc = cycleCount + 1;
-                                }
+                                inst->phys_dest = freePhysRegs.back();
+                                freePhysRegs.pop_back();
+                                inst->prev_phys = thread.renameMap[inst->dest_reg];
+                                thread.renameMap[inst->dest_reg] = inst->phys_dest;
                         }
+                        reorderBuffer.push_back(inst);
                 }
 
-                // Any fired-but-not-completed instruction keeps accumulating wait cycles
-                for (auto inst : pipelineInstQueue)
+                inst->dispatched = true;
+                inst->sched_cyc = cycleCount + 1;
+                if (inst->src_ready[0] && inst->src_ready[1])
+                        markIssuable(inst);
+                else
+                        ++waitingOnSource;
+        }
+}
+
+// The stall counter for why inst, ready to dispatch, can't be; nullptr
+// if it can
+uint64_t *Processor::dispatchStall(_proc_inst_t *inst)
+{
+        if (freeReservationSlots == 0)
+                return &util.stall_rs_full;
+        if (reorderBufferSize > 0 && static_cast<int>(reorderBuffer.size()) == reorderBufferSize)
+                return &util.stall_rob_full;
+        if (reorderBufferSize > 0 && inst->dest_reg != -1 && freePhysRegs.empty())
+                return &util.stall_regs_full;
+        return nullptr;
+}
+
+// True if unit can start executing an instruction next cycle
+static bool canStart(const Function_k &unit, int cycle)
+{
+        return unit.waiting == 0 && unit.next_start <= cycle + 1;
+}
+
+// Issue any ready instructions into functional units, oldest first
+void Processor::issueInstructions()
+{
+        for (int t = 0; t < 3; t++)
+        {
+                fuAvailableUnits[t] = 0;
+                for (auto &unit : fuPool[t].units)
+                        fuAvailableUnits[t] += canStart(unit, cycleCount);
+        }
+
+        // Only what's in the RS waits on its sources; what's held in the
+        // dispatch queue is counted by dispatchInstructions, as held up
+        // by a full RS (or ROB), so each stall has one reason
+        util.stall_source += waitingOnSource;
+
+        // The oldest are from the window's base to its end, then from its
+        // start round to the base again
+        size_t words = window.size() / 64;
+        size_t base = windowBase & (window.size() - 1);
+        for (int t = 0; t < 3; t++)
+        {
+                for (size_t i = 0; i <= words && issuableCount[t] > 0 && fuAvailableUnits[t] > 0; i++)
                 {
-                        if (inst->fired && !inst->completed)
-                                ++inst->fu_wait;
+                        size_t w = (base / 64 + i) & (words - 1);
+                        uint64_t bits = issuable[t][w];
+                        if (i == 0)
+                                bits &= ~0ull << (base % 64);
+                        else if (i == words)
+                                bits &= ~(~0ull << (base % 64));
+                        for (; bits != 0 && fuAvailableUnits[t] > 0; bits &= bits - 1)
+                                issueInstruction(window[w * 64 + __builtin_ctzll(bits)]);
                 }
+                util.stall_fu += issuableCount[t];
         }
+}
+
+// Start an instruction executing in the first unit of its type that's free
+void Processor::issueInstruction(_proc_inst_t *inst)
+{
+        size_t slot = inst->dest_tag & (window.size() - 1);
+        issuable[inst->op_code][slot / 64] &= ~(1ull << (slot % 64));
+        --issuableCount[inst->op_code];
+        --threads[inst->thread].unissued;
+
+        inst->fired = true;
+        inst->fu_busy = true;
+        ++executingCount;
+        --fuAvailableUnits[inst->op_code];
+        inst->exec_cyc = cycleCount + 1;
 
-        // When a CDB slot frees, mark the register as ready
-        void updateRegisterFile()
+        auto &units = fuPool[inst->op_code].units;
+        int u = 0;
+        while (!canStart(units[u], cycleCount))
+                ++u;
+        auto &unit = units[u];
+        inst->fu_unit = u;
+        unit.tag = inst->dest_tag;
+        unit.dest_reg = inst->dest_reg;
+        unit.next_start = inst->exec_cyc + inst->interval;
+        if (unit.count++ == 0)
         {
-                for (auto inst : pipelineInstQueue)
+                unit.busy = true;
+                ++fuBusyUnits[inst->op_code];
+        }
+
+        // Ask for a result bus as soon as it finishes
+        int finish = inst->exec_cyc + inst->latency - 1;
+        if (finish == cycleCount + 1)
+                requestCdb(inst, finish);
+        else
+        {
+                finishing.push_back({finish, inst->dest_tag, inst});
+                std::push_heap(finishing.begin(), finishing.end(), std::greater<CdbRequest>());
+        }
+}
+
+// An instruction finishing execution in cycle finish asks for a result
+// bus, which holds up its unit until it gets one
+void Processor::requestCdb(_proc_inst_t *inst, int finish)
+{
+        auto &heap = cdbRequests[inst->op_code];
+        int key = options.cdb_policy == CDB_OLDEST_FIRST ? inst->dest_tag : finish;
+        heap.push_back({key, inst->dest_tag, inst});
+        std::push_heap(heap.begin(), heap.end(), std::greater<CdbRequest>());
+        ++fuPool[inst->op_code].units[inst->fu_unit].waiting;
+        ++cdbWaiting;
+}
+
+// Put the most deserving instruction of FU type t on a result bus
+void Processor::grantCdb(int t)
+{
+        auto &heap = cdbRequests[t];
+        std::pop_heap(heap.begin(), heap.end(), std::greater<CdbRequest>());
+        auto inst = heap.back().inst;
+        heap.pop_back();
+
+        --robAvailable;
+        --executingCount;
+        --cdbWaiting;
+        auto &unit = fuPool[t].units[inst->fu_unit];
+        --unit.waiting;
+        if (--unit.count == 0)
+        {
+                unit.busy = false;
+                --fuBusyUnits[t];
+        }
+        inst->fu_busy = false;
+        inst->fu_wait = cycleCount - (inst->exec_cyc + inst->latency - 1);
+        inst->CDB_busy = true;
+        inst->completed = true;
+        granted.push_back(inst);
+        inst->stateUp_cyc = cycleCount + 1;
+        auto &fetched = threads[inst->thread].lastFetched;
+        if (inst->dest_tag == fetched.tag)
+                fetched.resolved = inst->stateUp_cyc;
+}
+
+// Advance execution: write back from FUs onto free CDBs.  Whatever
+// finishes executing this cycle joins those asking for a bus, and
+// it's only a matter of which of them get one.
+void Processor::executeInstructions()
+{
+        while (!finishing.empty() && finishing.front().key <= cycleCount)
+        {
+                std::pop_heap(finishing.begin(), finishing.end(), std::greater<CdbRequest>());
+                requestCdb(finishing.back().inst, finishing.back().key);
+                finishing.pop_back();
+        }
+
+        if (options.cdb_policy == CDB_ROUND_ROBIN)
+        {
+                // One per FU type at a time, starting one type further
+                // along each cycle
+                for (int t = cdbNextType; robAvailable > 0 && cdbWaiting > 0; t = (t + 1) % 3)
+                        if (!cdbRequests[t].empty())
+                                grantCdb(t);
+                cdbNextType = (cdbNextType + 1) % 3;
+                util.stall_cdb += cdbWaiting;
+                return;
+        }
+
+        // Otherwise the best request of any type, over and over
+        while (robAvailable > 0 && cdbWaiting > 0)
+        {
+                int best = -1;
+                for (int t = 0; t < 3; t++)
+                        if (!cdbRequests[t].empty() &&
+                            (best == -1 || cdbRequests[best].front() > cdbRequests[t].front()))
+                                best = t;
+                grantCdb(best);
+        }
+        util.stall_cdb += cdbWaiting;
+}
+
+// When a CDB slot frees, mark the register as ready
+void Processor::updateRegisterFile()
+{
+        for (auto inst : granted)
+        {
+                auto &registerFile = threads[inst->thread].registerFile;
+                int d = (inst->dest_reg != -1 ? inst->dest_reg : 128);
+                if (registerFile[d].tag == inst->dest_tag)
                 {
-                        if (inst->CDB_busy)
-                        {
-                                int d = (inst->dest_reg != -1 ? inst->dest_reg : 128);
-                                if (registerFile[d].tag == inst->dest_tag)
-                                {
-                                        registerFile[d].ready = true;
-                                }
-                        }
+                        registerFile[d].ready = true;
                 }
         }
+}
 
-        // Broadcast tag availability to waiting instructions
-        void broadcastResults()
+// Broadcast tag availability to the instructions waiting on it
+void Processor::broadcastResults()
+{
+        for (auto inst : granted)
         {
-                for (auto inst : pipelineInstQueue)
+                auto waiter = inst->wake_head;
+                int src = inst->wake_head_src;
+                while (waiter != nullptr)
                 {
-                        if (inst->CDB_busy)
+                        waiter->src_ready[src] = true;
+                        if (waiter->src_ready[0] && waiter->src_ready[1])
                         {
-                                for (auto other : pipelineInstQueue)
-                                {
-                                        if (other->src_tag[0] == inst->dest_tag)
-                                                other->src_ready[0] = true;
-                                        if (other->src_tag[1] == inst->dest_tag)
-                                                other->src_ready[1] = true;
-                                }
-                                inst->CDB_busy = false;
-                                ++robAvailable;
+                                --waitingOnSource;
+                                markIssuable(waiter);
                         }
+                        auto next = waiter->wake_next[src];
+                        src = waiter->wake_next_src[src];
+                        waiter = next;
                 }
+                inst->wake_head = nullptr;
+                inst->CDB_busy = false;
+                ++robAvailable;
         }
+}
 
-        // Remove completed instructions, record their timeline, free RS slots
-        void retireInstructions()
+// Save an instruction's timing until every older one has retired,
+// growing the buffer if it lags further behind than the buffer holds
+void Processor::recordTimeline(_proc_inst_t *inst)
+{
+        size_t size = timelineBuffer.size();
+        if (static_cast<size_t>(inst->dest_tag - nextTimelineTag) >= size)
         {
-                for (auto it = pipelineInstQueue.begin(); it != pipelineInstQueue.end();)
+                std::vector<std::array<int, NUM_STAGES>> grown(2 * size);
+                for (size_t i = 0; i < size; i++)
                 {
-                        auto inst = *it;
-                        if (inst->completed)
+                        auto &row = timelineBuffer[(nextTimelineTag + i) & (size - 1)];
+                        grown[(nextTimelineTag + i) & (2 * size - 1)] = row;
+                }
+                timelineBuffer.swap(grown);
+                recordTimeline(inst);
+                return;
+        }
+
+        // Save timing: INST, FETCH, DISP, SCHED, EXEC, STATE
+        auto &row = timelineBuffer[inst->dest_tag & (size - 1)];
+        row[STAGE_INST] = inst->dest_tag + 1;
+        row[STAGE_FETCH] = inst->fet_cyc;
+        row[STAGE_DISP] = inst->disp_cyc;
+        row[STAGE_SCHED] = inst->sched_cyc;
+        row[STAGE_EXEC] = inst->exec_cyc;
+        row[STAGE_STATE] = inst->stateUp_cyc;
+}
+
+// Print the rows of the oldest retired instructions, in order, up to
+// the first one still in flight
+void Processor::flushTimeline()
+{
+        size_t mask = timelineBuffer.size() - 1;
+        for (;;)
+        {
+                auto &row = timelineBuffer[nextTimelineTag & mask];
+                if (row[STAGE_INST] == 0)
+                        break;
+                if (timeline != nullptr)
+                        timeline->row(row.data());
+                row[STAGE_INST] = 0;
+                ++nextTimelineTag;
+        }
+}
+
+// Remove the instructions that completed this cycle from the window,
+// record their timeline, free RS slots
+void Processor::retireInstructions()
+{
+        size_t mask = window.size() - 1;
+        for (auto inst : granted)
+        {
+                ++freeReservationSlots;
+                recordTimeline(inst);
+                window[inst->dest_tag & mask] = nullptr;
+                --inFlight;
+                if (reorderBufferSize == 0)
+                {
+                        threads[inst->thread].cycles = cycleCount + 1;
+                        freeInsts.push_back(inst);
+                }
+        }
+        granted.clear();
+        while (windowBase < nextInstructionTag && window[windowBase & mask] == nullptr)
+                ++windowBase;
+        flushTimeline();
+}
+
+// Commit from the head of the ROB, in order, the cycle after a result is
+// written back at the earliest.  The physical register an instruction's
+// destination was in before it can't be read by anything any more.
+void Processor::commitInstructions()
+{
+        for (int n = 0; n < commitWidth && !reorderBuffer.empty(); n++)
+        {
+                auto inst = reorderBuffer.front();
+                if (!inst->completed || inst->stateUp_cyc > cycleCount)
+                        break;
+                if (inst->prev_phys != -1)
+                        freePhysRegs.push_back(inst->prev_phys);
+                reorderBuffer.pop_front();
+                threads[inst->thread].cycles = cycleCount + 1;
+                freeInsts.push_back(inst);
+        }
+}
+
+// The first cycle, from this one on, in which some stage will do
+// something.  Anything that has finished executing gets a CDB or waits
+// for one every cycle, and so does fetch while it has room and
+// instructions and isn't waiting on a branch, so only look further
+// when neither is true.
+int Processor::nextEventCycle()
+{
+        if (cdbWaiting > 0)
+                return cycleCount;
+
+        // Fetch picks up again once a thread with instructions left has
+        // recovered from a branch
+        int next = -1;
+        if (fetchRoom() > 0)
+        {
+                for (auto &thread : threads)
+                {
+                        int resume = thread.resumeCycle;
+                        if (thread.heldInst == nullptr && !thread.source->hasAtLeast(thread.fetched + 1))
+                                continue;
+                        if (thread.heldInst != nullptr && resume == INT_MAX)
                         {
-                                ++freeReservationSlots;
-                                // Save timing: INST, FETCH, DISP, SCHED, EXEC, STATE
-                                instructionTimeline[inst->dest_tag][STAGE_INST] = inst->dest_tag + 1;
-                                instructionTimeline[inst->dest_tag][STAGE_FETCH] = inst->fet_cyc;
-                                instructionTimeline[inst->dest_tag][STAGE_DISP] = inst->disp_cyc;
-                                instructionTimeline[inst->dest_tag][STAGE_SCHED] = inst->sched_cyc;
-                                instructionTimeline[inst->dest_tag][STAGE_EXEC] = inst->exec_cyc;
-                                instructionTimeline[inst->dest_tag][STAGE_STATE] = inst->stateUp_cyc;
-                                it = pipelineInstQueue.erase(it);
-                                delete inst;
+                                if (thread.lastFetched.resolved == -1)
+                                        continue;
+                                resume = thread.lastFetched.resolved + options.mispredict_penalty;
                         }
-                        else
+                        int at = std::max(fetchCycle, resume);
+                        if (next == -1 || at < next)
+                                next = at;
+                }
+        }
+        if (next != -1 && next <= cycleCount)
+                return cycleCount;
+
+        // And the next instruction still executing finishes
+        if (!finishing.empty() && (next == -1 || finishing.front().key < next))
+                next = finishing.front().key;
+
+        // The instruction at the head of the ROB commits
+        if (!reorderBuffer.empty() && reorderBuffer.front()->completed &&
+            (next == -1 || reorderBuffer.front()->stateUp_cyc < next))
+                next = reorderBuffer.front()->stateUp_cyc;
+
+        // The first cycle each FU type can issue an instruction in; none
+        // are held up waiting for a CDB by now
+        int fuFree[3];
+        for (int t = 0; t < 3; t++)
+        {
+                fuFree[t] = INT_MAX;
+                for (auto &unit : fuPool[t].units)
+                        fuFree[t] = std::min(fuFree[t], unit.next_start - 1);
+        }
+
+        // The oldest instruction waiting to dispatch can, and whatever
+        // is ready to issue (it has been in the RS a cycle by now) gets
+        // a unit
+        if (!dispatchQueue.empty() && freeReservationSlots > 0 &&
+            (reorderBufferSize == 0 || static_cast<int>(reorderBuffer.size()) < reorderBufferSize) &&
+            (next == -1 || dispatchQueue.front()->disp_cyc < next))
+                next = dispatchQueue.front()->disp_cyc;
+        for (int t = 0; t < 3; t++)
+        {
+                int at = std::max(fuFree[t], cycleCount);
+                if (issuableCount[t] > 0 && fuFree[t] != INT_MAX && (next == -1 || at < next))
+                        next = at;
+        }
+
+        // Nothing scheduled means nothing in flight, or a machine
+        // that can't make progress; either way, don't skip
+        return std::max(next, cycleCount);
+}
+
+// Jump to cycle until, keeping up the statistics of the cycles
+// skipped.  Only the dispatch queue statistics and the round-robin CDB
+// pointer change in an idle cycle; once fetch has passed the end of the
+// trace the queue size is constant and the rest can be added up at once.
+void Processor::skipToCycle(int until)
+{
+        // Nothing moves in the cycles skipped, so whatever was stalled
+        // stays stalled
+        if (until > cycleCount)
+        {
+                uint64_t skipped = until - cycleCount;
+                cdbNextType = static_cast<int>((cdbNextType + skipped) % 3);
+                sampleUtilization(skipped);
+                for (size_t i = 0; i < dispatchQueue.size(); i++)
+                {
+                        uint64_t *blocked = dispatchStall(dispatchQueue[i]);
+                        if (blocked != nullptr)
                         {
-                                ++it;
+                                *blocked += skipped * (dispatchQueue.size() - i);
+                                break;
                         }
                 }
+                util.stall_source += waitingOnSource * skipped;
+                for (int t = 0; t < 3; t++)
+                        util.stall_fu += issuableCount[t] * skipped;
+                if (fetchRoom() == 0 && moreToFetch())
+                        util.fetch_lost += fetchWidth * skipped;
         }
 
-} // end anonymous namespace
+        while (cycleCount < until && !pastEndOfTrace)
+        {
+                updateDispatchStats();
+                ++cycleCount;
+        }
+        totalDispatchQueueSizeSum += currentDispatchQueueSize * static_cast<unsigned long>(until - cycleCount);
+        cycleCount = until;
+}
 
-void setup_proc(uint64_t r, uint64_t k0, uint64_t k1,
-                uint64_t k2, uint64_t f)
+// Count the state of the machine as it stands for this many cycles
+void Processor::sampleUtilization(uint64_t cycles)
+{
+        util.cycles += cycles;
+        for (int t = 0; t < 3; t++)
+                util.fu_busy[t][fuBusyUnits[t]] += cycles;
+        util.cdb_busy[robCapacity - robAvailable] += cycles;
+        util.rs_busy[scheduleQueueSize - freeReservationSlots] += cycles;
+        util.rob_busy[reorderBuffer.size()] += cycles;
+}
+
+Processor::Processor(uint64_t r, uint64_t k0, uint64_t k1,
+                     uint64_t k2, uint64_t f, const proc_options_t &o)
+    : options(o)
 {
         // Initialize resource counts from driver parameters
         robCapacity = static_cast<int>(r);
@@ -303,39 +842,175 @@ void setup_proc(uint64_t r, uint64_t k0, uint64_t k1,
                 fuAvailableUnits[i] = fuCapacity[i];
         }
 
+        // Execution timing of each op code, by its FU type unless set
+        // for the op code itself; branches (-1) execute on k1 units
+        for (int op = -1; op < 3; op++)
+        {
+                int t = op == -1 ? 1 : op;
+                opLatency[op + 1] = options.op_latency[op + 1] ? options.op_latency[op + 1] : options.fu_latency[t];
+                opInterval[op + 1] = options.op_interval[op + 1] ? options.op_interval[op + 1] : options.fu_interval[t];
+        }
+
         fetchWidth = static_cast<int>(f);
         scheduleQueueSize = 2 * (k0 + k1 + k2);
         freeReservationSlots = scheduleQueueSize;
+
+        // Room for twice the window to start with; it grows if need be
+        size_t timelineSize = 1;
+        while (timelineSize < 2 * static_cast<size_t>(scheduleQueueSize))
+                timelineSize *= 2;
+        timelineBuffer.assign(timelineSize, std::array<int, NUM_STAGES>());
+
+        // Instruction records for the whole window up front
+        size_t windowSize = scheduleQueueSize + fetchWidth;
+        instPool.resize(windowSize);
+        for (auto &inst : instPool)
+                freeInsts.push_back(&inst);
+
+        // And twice that in the window, a whole number of bitmap words
+        size_t windowSlots = 64;
+        while (windowSlots < 2 * windowSize)
+                windowSlots *= 2;
+        window.assign(windowSlots, nullptr);
+        for (int t = 0; t < 3; t++)
+                issuable[t].assign(windowSlots / 64, 0);
+
+        for (int t = 0; t < 3; t++)
+                util.fu_busy[t].assign(fuCapacity[t] + 1, 0);
+        util.cdb_busy.assign(robCapacity + 1, 0);
+        util.rs_busy.assign(scheduleQueueSize + 1, 0);
+
+        // The reorder buffer; its physical registers are set up once
+        // it's known how many threads there are
+        reorderBufferSize = options.rob_size;
+        commitWidth = options.commit_width > 0 ? options.commit_width : fetchWidth;
+        renameRegs = options.rename_regs > 0 ? options.rename_regs : reorderBufferSize;
+        util.rob_busy.assign(reorderBufferSize + 1, 0);
+
+        ownPredictor.reset(make_branch_predictor(options.predictor));
+        predictor = ownPredictor.get();
 }
 
-void run_proc(proc_stats_t *p_stats)
+// How many instructions source holds, found with hasAtLeast alone
+static uint64_t traceLength(InstructionSource &source)
+{
+        uint64_t have = 0, lack = 1;
+        while (source.hasAtLeast(lack))
+        {
+                have = lack;
+                lack *= 2;
+        }
+        while (lack - have > 1)
+        {
+                uint64_t mid = have + (lack - have) / 2;
+                if (source.hasAtLeast(mid))
+                        have = mid;
+                else
+                        lack = mid;
+        }
+        return have;
+}
+
+void Processor::sharePredictor(branch_predictor *shared)
+{
+        predictor = shared;
+}
+
+void Processor::run(InstructionSource &src, TimelineWriter *out)
 {
+        run(std::vector<InstructionSource *>(1, &src), out);
+}
+
+#ifdef PROCSIM_PROFILE
+// Makes the call, charging the host time since the previous one ended to
+// stage
+#define PROFILE_STAGE(stage, call)                                      \
+        do                                                              \
+        {                                                               \
+                call;                                                   \
+                uint64_t now = profile_ticks();                         \
+                profile.ticks[stage] += now - mark;                     \
+                mark = now;                                             \
+        } while (0)
+#else
+#define PROFILE_STAGE(stage, call) call
+#endif
+
+void Processor::run(const std::vector<InstructionSource *> &sources, TimelineWriter *out)
+{
+        timeline = out;
+
+        // Physical registers for each thread's 128 architectural ones,
+        // plus the rename registers
+        int n = static_cast<int>(sources.size());
+        threads.resize(n);
+        for (int t = 0; t < n; t++)
+        {
+                threads[t].source = sources[t];
+                if (reorderBufferSize > 0)
+                        for (int r = 0; r < 128; r++)
+                                threads[t].renameMap.push_back(128 * t + r);
+                if (n > 1)
+                        traceTotal += traceLength(*sources[t]);
+        }
+        if (reorderBufferSize > 0)
+                for (int r = 128 * n + renameRegs - 1; r >= 128 * n; r--)
+                        freePhysRegs.push_back(r);
+        // Round-robin starts with the first thread
+        fetchThread = n - 1;
+
+        // Rows of the timeline are printed as instructions retire
+        if (timeline != nullptr)
+                timeline->begin();
+
+#ifdef PROCSIM_PROFILE
+        PerfCounters counters;
+        auto wallStart = std::chrono::steady_clock::now();
+        counters.start();
+        uint64_t mark = profile_ticks(), ticksStart = mark;
+#endif
+
         // Continue cycle-by-cycle until no instructions remain in flight
+        // or to be fetched, skipping over cycles in which nothing would
+        // happen
         do
         {
-                executeInstructions();
-                updateRegisterFile();
-                issueInstructions();
-                dispatchInstructions();
-                fetchInstructions();
-                updateDispatchStats();
-                broadcastResults();
-                retireInstructions();
+                PROFILE_STAGE(PROF_EXECUTE, executeInstructions());
+                PROFILE_STAGE(PROF_UPDATE_RF, updateRegisterFile());
+                PROFILE_STAGE(PROF_ISSUE, issueInstructions());
+                PROFILE_STAGE(PROF_DISPATCH, dispatchInstructions());
+                PROFILE_STAGE(PROF_FETCH, fetchInstructions());
+                PROFILE_STAGE(PROF_UTILIZATION, sampleUtilization(1));
+                PROFILE_STAGE(PROF_DISPATCH_STATS, updateDispatchStats());
+                PROFILE_STAGE(PROF_BROADCAST, broadcastResults());
+                PROFILE_STAGE(PROF_RETIRE, retireInstructions());
+                PROFILE_STAGE(PROF_COMMIT, commitInstructions());
                 ++cycleCount;
-        } while (!pipelineInstQueue.empty());
+                if (inFlight > 0 || !reorderBuffer.empty() || moreToFetch())
+                        PROFILE_STAGE(PROF_SKIP, skipToCycle(nextEventCycle()));
+        } while (inFlight > 0 || !reorderBuffer.empty() || moreToFetch());
+
+#ifdef PROCSIM_PROFILE
+        counters.stop(&profile);
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - wallStart).count();
+        profile.ns_per_tick = mark > ticksStart ? ns / (mark - ticksStart) : 0;
+#endif
 }
 
-void complete_proc(proc_stats_t *p_stats)
+std::vector<proc_thread_stats_t> Processor::threadStats() const
 {
-        // Print header then each instruction’s lifecycle
-        printf("INST\tFETCH\tDISP\tSCHED\tEXEC\tSTATE\n");
-        for (int i = 0; i < MAX_INSTRUCTIONS; ++i)
-        {
-                for (int j = 0; j < 6; ++j)
-                        printf("%d\t", instructionTimeline[i][j]);
-                printf("\n");
-        }
-        printf("\n");
+        std::vector<proc_thread_stats_t> stats;
+        for (auto &thread : threads)
+                stats.push_back({thread.fetched, thread.cycles});
+        return stats;
+}
+
+void Processor::complete(proc_stats_t *p_stats)
+{
+        // Every row has been printed by now; end the timeline
+        flushTimeline();
+        if (timeline != nullptr)
+                timeline->end();
 
         // Fill out the stats struct for the driver to print
         p_stats->retired_instruction = nextInstructionTag;
@@ -345,3 +1020,94 @@ void complete_proc(proc_stats_t *p_stats)
         p_stats->max_disp_size = maximumDispatchQueueSize;
         p_stats->avg_disp_size = static_cast<double>(totalDispatchQueueSizeSum) / cycleCount;
 }
+
+// The driver's interface: one Processor reading the driver's trace and
+// printing its timeline to stdout
+namespace
+{
+        class DriverSource : public InstructionSource
+        {
+        public:
+                bool next(proc_inst_t *p_inst) override
+                {
+                        return read_instruction(p_inst);
+                }
+                bool hasAtLeast(uint64_t count) override
+                {
+                        return trace_has_instructions(count);
+                }
+        };
+
+        proc_options_t procOptions;
+        std::unique_ptr<Processor> processor;
+        DriverSource driverSource;
+        std::vector<InstructionSource *> driverThreads;
+        std::unique_ptr<TimelineWriter> driverTimeline(new TextTimeline(stdout));
+} // end anonymous namespace
+
+void set_proc_options(const proc_options_t *o)
+{
+        procOptions = *o;
+}
+
+void set_proc_timeline(TimelineWriter *timeline)
+{
+        driverTimeline.reset(timeline);
+}
+
+void set_proc_threads(const std::vector<InstructionSource *> &sources)
+{
+        driverThreads = sources;
+}
+
+void setup_proc(uint64_t r, uint64_t k0, uint64_t k1,
+                uint64_t k2, uint64_t f)
+{
+        processor.reset(new Processor(r, k0, k1, k2, f, procOptions));
+}
+
+void run_proc(proc_stats_t *p_stats)
+{
+        if (driverThreads.empty())
+                processor->run(driverSource, driverTimeline.get());
+        else
+                processor->run(driverThreads, driverTimeline.get());
+}
+
+void complete_proc(proc_stats_t *p_stats)
+{
+        processor->complete(p_stats);
+}
+
+void utilization_proc(proc_util_t *p_util)
+{
+        *p_util = processor->utilization();
+}
+
+void branch_stats_proc(proc_branch_stats_t *p_branch)
+{
+        *p_branch = processor->branchStats();
+}
+
+void thread_stats_proc(std::vector<proc_thread_stats_t> *p_threads)
+{
+        *p_threads = processor->threadStats();
+}
+
+#ifdef PROCSIM_PROFILE
+void profile_proc(proc_profile_t *p_profile)
+{
+        *p_profile = processor->profileStats();
+}
+#endif
+
+double util_mean(const std::vector<uint64_t> &histogram)
+{
+        uint64_t cycles = 0, total = 0;
+        for (size_t n = 0; n < histogram.size(); n++)
+        {
+                cycles += histogram[n];
+                total += n * histogram[n];
+        }
+        return cycles != 0 ? static_cast<double>(total) / cycles : 0.0;
+}
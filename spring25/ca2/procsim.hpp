@@ -4,7 +4,15 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <array>
+#include <deque>
+#include <memory>
+#include <utility>
 #include <vector>
+#include "trace_reader.hpp"
+#include "timeline.hpp"
+#include "branch_pred.hpp"
+#include "profile.hpp"
 
 // Default functional unit counts and fetch width
 #define DEFAULT_K0 1
@@ -38,7 +46,7 @@ typedef struct _proc_inst_t
     bool fired;                   // Has the instruction been issued to an FU?
     bool dispatched;              // Has it left the fetch/dispatch queue?
     bool _null;                   // True if read_instruction hit EOF
-    int fu_wait;                  // Cycles spent waiting in the FU
+    int fu_wait;                  // Cycles it waited in the FU for a CDB
     int fet_cyc;                  // Cycle when fetched
     int disp_cyc;                 // Cycle when dispatched
     int sched_cyc;                // Cycle when scheduled into a FU
@@ -47,6 +55,20 @@ typedef struct _proc_inst_t
     bool completed;               // Has it finished write-back?
     bool fu_busy;                 // Is it currently occupying an FU?
     bool CDB_busy;                // Is it waiting on a result bus?
+    int latency;                  // Cycles it takes to execute
+    int interval;                 // Cycles before its FU can start another
+    int fu_unit;                  // Which unit of its type it's in
+    int phys_dest;                // Physical register renamed to, with a ROB
+    int prev_phys;                // The one dest_reg was in before, freed at commit
+    int thread;                   // SMT thread it was fetched by
+
+    // Instructions waiting on this one's result, as a list threaded
+    // through their wake_next: the first waiter and which of its sources
+    _proc_inst_t *wake_head;
+    int wake_head_src;
+    // Next instruction waiting on the same producer as each source
+    _proc_inst_t *wake_next[2];
+    int wake_next_src[2];
 
     // Initialize flags and tags to defaults
     _proc_inst_t()
@@ -55,10 +77,17 @@ typedef struct _proc_inst_t
         {
             src_ready[i] = false;
             src_tag[i] = -1;
+            wake_next[i] = nullptr;
+            wake_next_src[i] = -1;
         }
+        wake_head = nullptr;
+        wake_head_src = -1;
         dispatched = completed = fired = fu_busy = CDB_busy = false;
         fet_cyc = disp_cyc = sched_cyc = exec_cyc = stateUp_cyc = -1;
         fu_wait = 0;
+        latency = interval = 1;
+        fu_unit = phys_dest = prev_phys = -1;
+        thread = 0;
         _null = false;
     }
 } proc_inst_t;
@@ -74,10 +103,117 @@ typedef struct _proc_stats_t
     unsigned long cycle_count;         // Total cycles taken
 } proc_stats_t;
 
-// Reads one instruction line from stdin into p_inst.
+// Where the cycles went: how busy each resource was, cycle by cycle, and
+// why instructions that could have moved on didn't.  The histograms are
+// indexed by how many were busy, sampled once a cycle after dispatch.
+typedef struct _proc_util_t
+{
+    uint64_t cycles;                  // cycles sampled
+    std::vector<uint64_t> fu_busy[3]; // FUs of each type holding an instruction
+    std::vector<uint64_t> cdb_busy;   // result buses granted
+    std::vector<uint64_t> rs_busy;    // RS entries in use
+    std::vector<uint64_t> rob_busy;   // ROB entries in use, with a ROB
+
+    // Instruction-cycles lost, by reason
+    uint64_t stall_source;  // in the RS, waiting on a source
+    uint64_t stall_fu;      // in the RS and ready, but no FU of its type free
+    uint64_t stall_cdb;     // finished in an FU, but no result bus free
+    uint64_t stall_rs_full; // fetched, but no RS entry to dispatch into
+    uint64_t stall_rob_full;  // fetched, but no ROB entry
+    uint64_t stall_regs_full; // fetched, but no physical register for it
+    uint64_t fetch_lost;    // fetch slots unused because the RS (or ROB) was full
+} proc_util_t;
+
+// What branch prediction cost fetch
+typedef struct _proc_branch_stats_t
+{
+    uint64_t branches;    // branches checked against the predictor
+    uint64_t mispredicts; // of those, the ones predicted the wrong way
+    uint64_t fetch_lost;  // cycles fetch spent recovering from them
+} proc_branch_stats_t;
+
+// One thread's share of an SMT run
+typedef struct _proc_thread_stats_t
+{
+    uint64_t instructions; // instructions it retired
+    uint64_t cycles;       // cycles until its last one had
+} proc_thread_stats_t;
+
+// Mean of a utilization histogram
+double util_mean(const std::vector<uint64_t> &histogram);
+
+// How result buses are handed out when more instructions finish than
+// there are buses
+enum CdbPolicy
+{
+    CDB_LONGEST_WAIT = 0, // earliest exec_cyc first, then program order
+    CDB_OLDEST_FIRST,     // program order
+    CDB_ROUND_ROBIN       // one per FU type in turn, longest wait first
+};
+
+// Which thread gets each fetch cycle when several share the processor
+enum FetchPolicy
+{
+    FETCH_ROUND_ROBIN = 0, // each in turn
+    FETCH_ICOUNT           // the one with the fewest fetched but not issued
+};
+
+// Settings beyond the assignment's R, k0-k2 and F
+typedef struct _proc_options_t
+{
+    CdbPolicy cdb_policy;
+    BranchPredictorKind predictor;
+    BranchRecovery branch_recovery;
+    int mispredict_penalty; // cycles lost on top of what recovery waits for
+    FetchPolicy fetch_policy;
+
+    // Cycles an instruction takes to execute on each FU type, and cycles
+    // between instructions starting in one unit: 1 for a pipelined unit,
+    // the latency for one that isn't
+    int fu_latency[3];
+    int fu_interval[3];
+    // The same for trace op codes -1 (branches) to 2, indexed by op code
+    // plus one; 0 to go by their FU type
+    int op_latency[4];
+    int op_interval[4];
+
+    // A reorder buffer of this many entries, 0 for none (the assignment's
+    // machine, where instructions leave as soon as they complete).  With
+    // one, instructions commit in order, commit_width a cycle (0 for F),
+    // and each result needs one of rename_regs physical registers on top
+    // of the architectural ones (0 for as many as the ROB has entries).
+    int rob_size;
+    int commit_width;
+    int rename_regs;
+
+    _proc_options_t()
+        : cdb_policy(CDB_LONGEST_WAIT), predictor(BP_PERFECT),
+          branch_recovery(RECOVER_REDIRECT), mispredict_penalty(0),
+          fetch_policy(FETCH_ROUND_ROBIN),
+          rob_size(0), commit_width(0), rename_regs(0)
+    {
+        for (int t = 0; t < 3; t++)
+            fu_latency[t] = fu_interval[t] = 1;
+        for (int op = 0; op < 4; op++)
+            op_latency[op] = op_interval[op] = 0;
+    }
+} proc_options_t;
+
+// Reads the next instruction of the trace into p_inst, from the driver's
+// TraceReader (or its in-memory replay when the trace is simulated twice);
+// each SMT thread reads its own TraceReader instead.
 // Returns true if a valid instruction was parsed.
 bool read_instruction(proc_inst_t *p_inst);
 
+// True if the trace holds at least count instructions in all, including
+// those already read.
+bool trace_has_instructions(uint64_t count);
+
+// The functions below drive a single Processor (see the end of this file)
+// for the driver, reading instructions with read_instruction and
+// trace_has_instructions and printing the timeline to stdout, or as
+// set_proc_timeline says.
+
 // Configure the pipeline:
 //   robSize       : number of entries in the Re-Order Buffer (result buses)
 //   fu0Count,1,2  : number of functional units of each type
@@ -88,22 +224,55 @@ void setup_proc(uint64_t robSize,
                 uint64_t fu2Count,
                 uint64_t fetchWidth);
 
+// Optional settings; call before setup_proc
+void set_proc_options(const proc_options_t *options);
+
+// Where the timeline goes instead of text on stdout, nullptr for nowhere;
+// call before run_proc.  procsim takes ownership of the writer.
+void set_proc_timeline(TimelineWriter *timeline);
+
 // Runs the simulation until all instructions complete
 void run_proc(proc_stats_t *p_stats);
 
 // Final cleanup, prints per-instruction timing and computes averages
 void complete_proc(proc_stats_t *p_stats);
 
+// Copies out the utilization counters; call after complete_proc
+void utilization_proc(proc_util_t *p_util);
+
+// Copies out the branch prediction counters; call after complete_proc
+void branch_stats_proc(proc_branch_stats_t *p_branch);
+
+class InstructionSource;
+
+// Runs one SMT thread on each of sources instead of reading the trace
+// with read_instruction; call before run_proc.  The sources must outlive
+// the run.
+void set_proc_threads(const std::vector<InstructionSource *> &sources);
+
+// Copies out each thread's instructions and cycles; call after complete_proc
+void thread_stats_proc(std::vector<proc_thread_stats_t> *p_threads);
+
+#ifdef PROCSIM_PROFILE
+// Copies out the host time each stage took; call after complete_proc
+void profile_proc(proc_profile_t *p_profile);
+#endif
+
 // Internal helper classes -------------------------------------------------
 
-// Tracks a single functional unit slot
+// Tracks a single functional unit slot.  A pipelined unit can hold
+// several instructions at once; one that has finished but has no result
+// bus yet holds the unit up until it gets one.
 class Function_k
 {
 public:
-    bool busy;    // Is the unit occupied?
-    int tag;      // Which instruction tag is using it?
-    int dest_reg; // Destination register for the result
-    Function_k() : busy(false), tag(-1), dest_reg(-1) {}
+    bool busy;      // Is the unit occupied?
+    int tag;        // Which instruction tag started in it last?
+    int dest_reg;   // Destination register for its result
+    int count;      // Instructions in it, executing or waiting for a CDB
+    int waiting;    // Of those, finished ones waiting for a CDB
+    int next_start; // First cycle another instruction can start executing
+    Function_k() : busy(false), tag(-1), dest_reg(-1), count(0), waiting(0), next_start(0) {}
 };
 
 // A pool of Function_k units, dynamically sized
@@ -117,9 +286,272 @@ public:
 class Register_File
 {
 public:
-    bool ready; // true if value is valid
-    int tag;    // tag of the instruction that will produce it
-    Register_File() : ready(true), tag(-1) {}
+    bool ready;              // true if value is valid
+    int tag;                 // tag of the instruction that will produce it
+    _proc_inst_t *producer;  // that instruction, while it's in flight
+    Register_File() : ready(true), tag(-1), producer(nullptr) {}
+};
+
+// Where a Processor gets its instructions
+class InstructionSource
+{
+public:
+    virtual ~InstructionSource() {}
+
+    // Reads the next instruction into p_inst; false at the end of the trace
+    virtual bool next(proc_inst_t *p_inst) = 0;
+
+    // True if the trace holds at least count instructions in all,
+    // including those already read
+    virtual bool hasAtLeast(uint64_t count) = 0;
+};
+
+// Reads a trace that is already in memory.  The records aren't copied, so
+// any number of sources, on any number of threads, can share one trace.
+class TraceBufferSource : public InstructionSource
+{
+public:
+    explicit TraceBufferSource(const std::vector<trace_record_t> &records)
+        : records(records), pos(0) {}
+    bool next(proc_inst_t *p_inst) override;
+    bool hasAtLeast(uint64_t count) override { return count <= records.size(); }
+
+private:
+    const std::vector<trace_record_t> &records;
+    size_t pos;
+};
+
+// One simulated processor.  All of its state lives here, so a process can
+// simulate any number of configurations, one after another or on several
+// threads at once.
+class Processor
+{
+public:
+    Processor(uint64_t robSize, uint64_t fu0Count, uint64_t fu1Count,
+              uint64_t fu2Count, uint64_t fetchWidth,
+              const proc_options_t &options = proc_options_t());
+
+    // Instructions point into instPool, so a Processor can't be copied
+    Processor(const Processor &) = delete;
+    Processor &operator=(const Processor &) = delete;
+
+    // Runs until every instruction from source has retired, handing the
+    // timeline to timeline (unless it's nullptr) as instructions retire
+    void run(InstructionSource &source, TimelineWriter *timeline);
+
+    // The same with one thread per source, all sharing the FUs, result
+    // buses and RS (SMT).  Each has its own registers; fetch picks one
+    // thread a cycle, by options.fetch_policy.
+    void run(const std::vector<InstructionSource *> &sources, TimelineWriter *timeline);
+
+    // Predicts branches with shared, which must outlive the run, rather
+    // than a predictor of its own, so what it learned carries over from
+    // one run to the next; call before run
+    void sharePredictor(branch_predictor *shared);
+
+    // Ends the timeline and computes the final statistics
+    void complete(proc_stats_t *p_stats);
+
+    // Utilization and stall counters so far
+    const proc_util_t &utilization() const { return util; }
+
+    // Branch prediction counters so far
+    const proc_branch_stats_t &branchStats() const { return branches; }
+
+    // Each thread's instructions, and the cycles it took to retire them
+    std::vector<proc_thread_stats_t> threadStats() const;
+
+#ifdef PROCSIM_PROFILE
+    // Host time spent in each stage so far
+    const proc_profile_t &profileStats() const { return profile; }
+#endif
+
+private:
+    // An instruction in an FU waiting for a result bus.  key is what the
+    // CDB policy orders by, ahead of the tag.  Instructions still
+    // executing are kept the same way, keyed by the cycle they finish.
+    struct CdbRequest
+    {
+        int key;
+        int tag;
+        _proc_inst_t *inst;
+        bool operator>(const CdbRequest &o) const
+        {
+            return key != o.key ? key > o.key : tag > o.tag;
+        }
+    };
+
+    // Pipeline stages, in the order run calls them each cycle
+    void executeInstructions();
+    void updateRegisterFile();
+    void issueInstructions();
+    void dispatchInstructions();
+    void fetchInstructions();
+    void updateDispatchStats();
+    void broadcastResults();
+    void retireInstructions();
+    void commitInstructions();
+
+    struct Thread;
+    _proc_inst_t *fetchNextInstruction();
+    bool pickFetchThread();
+    bool waitingOnBranch(Thread &thread);
+    bool moreToFetch();
+    bool traceHasAtLeast(uint64_t count);
+    bool checkBranch(Thread &thread, _proc_inst_t *next);
+    void redirectFetch(Thread &thread, int resume);
+    void addToWindow(_proc_inst_t *inst);
+    void markIssuable(_proc_inst_t *inst);
+    int fetchRoom();
+    uint64_t *dispatchStall(_proc_inst_t *inst);
+    void issueInstruction(_proc_inst_t *inst);
+    void requestCdb(_proc_inst_t *inst, int finish);
+    void grantCdb(int t);
+    void recordTimeline(_proc_inst_t *inst);
+    void flushTimeline();
+    int nextEventCycle();
+    void skipToCycle(int until);
+    void sampleUtilization(uint64_t cycles);
+
+    proc_options_t options;
+    TimelineWriter *timeline = nullptr;
+
+    // Current size of the dispatch queue (waiting to be scheduled)
+    unsigned long currentDispatchQueueSize = 0;
+    // Largest we ever saw the dispatch queue get
+    unsigned long maximumDispatchQueueSize = 0;
+    // Running sum of dispatch queue sizes (for average)
+    unsigned long totalDispatchQueueSizeSum = 0;
+    // Set once fetchWidth * cycleCount passes the end of the trace
+    bool pastEndOfTrace = false;
+
+    proc_util_t util = proc_util_t();
+
+    // Timing stages of retired instructions that can't be printed until an
+    // older one retires, indexed by tag modulo its (power of two) size.  A
+    // row whose STAGE_INST is 0 is empty.
+    std::vector<std::array<int, NUM_STAGES>> timelineBuffer;
+    // Oldest instruction whose row hasn't been printed yet
+    int nextTimelineTag = 0;
+
+    // Next unique tag assigned to a fetched instruction
+    int nextInstructionTag = 0;
+
+    // Cycle the next instruction is fetched in, and how many have been
+    // fetched in that cycle already
+    int fetchCycle = 1;
+    int fetchSlot = 0;
+    // Cycles fetch does something in, for the dispatch queue statistics
+    uint64_t fetchCycles = 0;
+
+    // Branch prediction.  A branch is only checked once the instruction
+    // after it has been read and shows which way it went, so this is what
+    // that takes of the instruction a thread fetched last.  Threads share
+    // the predictor.
+    struct FetchedInst
+    {
+        uint32_t pc;
+        int tag;
+        int fet_cyc;
+        bool branch;
+        int resolved; // its stateUp_cyc, once it has a result bus
+    };
+    std::unique_ptr<branch_predictor> ownPredictor;
+    branch_predictor *predictor = nullptr; // that one, or one shared
+    proc_branch_stats_t branches = proc_branch_stats_t();
+    // Cycles fetch spends recovering, or with no thread to fetch from,
+    // [first, end), oldest first; end is INT_MAX until a branch resolves
+    std::deque<std::pair<int, int>> fetchBubbles;
+
+    // What each thread has to itself.  Tags are still handed out across
+    // all of them, in the order they're fetched, so a thread's register
+    // file only ever holds its own tags.
+    struct Thread
+    {
+        InstructionSource *source = nullptr;
+        Register_File registerFile[129]; // entry 128 acts as “dummy reg”
+        std::vector<int> renameMap;      // physical register of each architectural one, with a ROB
+        FetchedInst lastFetched = {0, -1, 0, false, -1};
+        // Read past a mispredicted branch, until fetch can take it: the
+        // first cycle it can, or INT_MAX until the branch resolves
+        _proc_inst_t *heldInst = nullptr;
+        int resumeCycle = 0;
+        uint64_t fetched = 0;  // instructions it has been given tags for
+        int unissued = 0;      // of those, not yet issued (ICOUNT)
+        uint64_t cycles = 0;   // cycles until its last one retired
+    };
+    std::vector<Thread> threads;
+    int fetchThread = 0; // the thread fetching in fetchCycle
+    // Instructions in all the threads' traces, with several
+    uint64_t traceTotal = 0;
+
+    // Available resources in the pipeline
+    int robCapacity = 0;           // total result buses / ROB entries
+    int robAvailable = 0;          // how many remain free
+    int fuCapacity[3] = {0};       // total FUs per op code
+    int fuAvailableUnits[3] = {0}; // how many FUs of each type can start one
+    int fuBusyUnits[3] = {0};      // how many FUs of each type hold one
+    int fetchWidth = 0;            // instructions fetched per cycle
+    int scheduleQueueSize = 0;     // size of schedule queue (2×FUs)
+    int freeReservationSlots = 0;  // how many RS entries remain
+    int executingCount = 0;        // fired but not yet on a CDB
+    int cdbWaiting = 0;            // of those, finished and asking for one
+
+    // Min-heaps of CDB requests for each FU type, and the type round-robin
+    // arbitration starts from next
+    std::vector<CdbRequest> cdbRequests[3];
+    int cdbNextType = 0;
+    // Min-heap of instructions taking more than a cycle, by when they
+    // finish, for those that haven't yet
+    std::vector<CdbRequest> finishing;
+    // Execution timing of trace op codes -1 to 2, indexed by op code plus one
+    int opLatency[4] = {0};
+    int opInterval[4] = {0};
+
+    int cycleCount = 1; // simulation cycle, starts at 1
+
+    // Pools of FUs
+    Function_Unit fuPool[3];
+
+    // The optional reorder buffer (robCapacity above is really the result
+    // buses): dispatched instructions, oldest first, until they commit
+    int reorderBufferSize = 0;
+    int commitWidth = 0;
+    std::deque<_proc_inst_t *> reorderBuffer;
+    // Physical registers behind it, shared by the threads' rename maps.
+    // Readiness is still tracked by tag in the register files, so these
+    // only decide whether there's one to rename to.
+    std::vector<int> freePhysRegs;
+    int renameRegs = 0;
+
+    // Instructions in flight, from fetch until they retire, indexed by
+    // tag modulo its (power of two) size; nullptr once retired.  It grows
+    // if the oldest one still in flight falls that far behind.
+    std::vector<_proc_inst_t *> window;
+    int windowBase = 0; // no older tag is still in flight
+    int inFlight = 0;   // how many are
+
+    // What each stage looks for in the window, kept up to date as it
+    // changes rather than searched for every cycle.  Instructions waiting
+    // to dispatch, in the order they will; a bitmap over the window per
+    // FU type of those in the RS with both sources ready, for issue to
+    // pick the oldest of by finding the first bit set; and those granted
+    // a result bus this cycle.
+    std::deque<_proc_inst_t *> dispatchQueue;
+    std::vector<uint64_t> issuable[3];
+    int issuableCount[3] = {0};
+    int waitingOnSource = 0; // in the RS with a source not ready
+    std::vector<_proc_inst_t *> granted;
+
+    // Storage for in-flight instructions, reused as they retire.  No more
+    // than the RS plus one fetch group are ever in flight, but the pool
+    // grows (without moving anything) if that ever stops being true.
+    std::deque<_proc_inst_t> instPool;
+    std::vector<_proc_inst_t *> freeInsts;
+
+#ifdef PROCSIM_PROFILE
+    proc_profile_t profile = proc_profile_t();
+#endif
 };
 
 #endif // PROCSIM_HPP
@@ -1,11 +1,26 @@
 #include <cstdio>
 #include <cinttypes>
+#include <climits>
 #include <cstdlib>
 #include <cstring>
+#include <chrono>
+#include <memory>
 #include <unistd.h>
+#include <sys/resource.h>
 #include "procsim.hpp"
+#include "trace_reader.hpp"
+#include "sweep.hpp"
+#include "sampling.hpp"
 
-FILE* inFile = stdin;
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
+
+// The file of each -i, in order: one per SMT thread
+std::vector<FILE*> inFiles;
+TraceReader traceReader;
+// The trace, once it has been read into memory to be simulated twice
+std::vector<trace_record_t> traceRecords;
+std::unique_ptr<TraceBufferSource> traceReplay;
 
 void print_help_and_exit(void) {
     printf("procsim [OPTIONS]\n");
@@ -14,8 +29,47 @@ void print_help_and_exit(void) {
     printf("  -l k2\t\tNumber of k2 FUs\n");   
     printf("  -f N\t\tNumber of instructions to fetch\n");
     printf("  -r R\t\tNumber of result buses\n");
-    printf("  -i traces/file.trace\n");
+    printf("  -i traces/file.trace\tText or binary (see trace_convert) trace; given\n");
+    printf("\t\tmore than once, each is a thread sharing the processor (SMT)\n");
+    printf("\t\tand the timeline numbers instructions in fetch order\n");
+    printf("  -F policy\tWhich thread fetches each cycle with several: rr\n");
+    printf("\t\t(round-robin, default) or icount (fewest not yet issued)\n");
+    printf("  -c policy\tResult bus arbitration: wait (longest wait, default),\n");
+    printf("\t\toldest (program order) or rr (round-robin over FU types)\n");
+    printf("  -t format\tTimeline as text (default), none (statistics only),\n");
+    printf("\t\tbinary (columns, see timeline.hpp) or gzip (text, compressed)\n");
+    printf("  -O file\tWrite the timeline to file instead of standard output\n");
+    printf("  -b predictor\tBranch predictor: perfect (default), taken, nottaken\n");
+    printf("\t\tor cbp (the ca1 predictor procsim was built with)\n");
+    printf("  -B recovery\tOn a misprediction fetch waits for the branch to write\n");
+    printf("\t\tback (redirect, default) or just the penalty (stall)\n");
+    printf("  -p N\t\tMisprediction penalty in cycles (default 0)\n");
+    printf("  -L list\tExecution latency of k0, k1 and k2 FUs, e.g. 1,3,10;\n");
+    printf("\t\top=N sets it for one trace op code (-1 for branches)\n");
+    printf("  -I list\tCycles between instructions starting in one FU, as -L;\n");
+    printf("\t\t1 (default) is pipelined, the latency unpipelined\n");
+    printf("  -R N\t\tReorder buffer of N entries, committing in order (default\n");
+    printf("\t\tnone: instructions leave as soon as they complete)\n");
+    printf("  -C N\t\tInstructions committed per cycle with -R (default F)\n");
+    printf("  -P N\t\tPhysical registers beyond the 128 architectural ones\n");
+    printf("\t\twith -R (default one per ROB entry)\n");
+    printf("  -u\t\tReport resource utilization and stalls after the statistics\n");
+    printf("  -M\t\tReport how fast it simulated and its peak RSS on stderr\n");
+    printf("  -s N\t\tSample: simulate one window of every N instructions in\n");
+    printf("\t\tdetail, fast-forward the rest and estimate the IPC; takes\n");
+    printf("\t\tone trace, and no -t, -O or -u\n");
+    printf("  -w W,U\t\tWith -s, W instructions of warm-up and then U measured\n");
+    printf("\t\tin each window (default 2000,1000)\n");
     printf("  -h\t\tThis helpful output\n");
+    printf("\n");
+    printf("procsim -S [OPTIONS] traces/file.trace...\n");
+    printf("  Simulates every combination of -j, -k, -l, -f and -r, which take\n");
+    printf("  lists and ranges such as 1-4,8, on each trace in one process\n");
+    printf("  -T N\t\tWorker threads (default one per CPU)\n");
+    printf("  -o file.csv\tIPC and statistics of every configuration\n");
+    printf("  -m file.csv\tCheapest configuration within %.0f%% of the best IPC\n", 100 * SWEEP_THRESHOLD);
+    printf("\t\tfor each trace and F; without -o, configurations that\n");
+    printf("\t\tcan't be it aren't simulated\n");
     exit(0);
 }
 
@@ -26,7 +80,7 @@ void print_help_and_exit(void) {
 //
 bool read_instruction(proc_inst_t* p_inst)
 {
-    int ret;
+    trace_record_t rec;
     
     if (p_inst == NULL)
     {
@@ -34,16 +88,139 @@ bool read_instruction(proc_inst_t* p_inst)
         return false;
     }
     
-    ret = fscanf(stdin, "%x %d %d %d %d\n", &p_inst->instruction_address,
-                 &p_inst->op_code, &p_inst->dest_reg, &p_inst->src_reg[0], &p_inst->src_reg[1]); 
-    if (ret != 5) {
+    if (traceReplay) {
+        return traceReplay->next(p_inst);
+    }
+    if (!traceReader.next(&rec)) {
         return false;
     }
     
+    p_inst->instruction_address = rec.instruction_address;
+    p_inst->op_code = rec.op_code;
+    p_inst->dest_reg = rec.dest_reg;
+    p_inst->src_reg[0] = rec.src_reg[0];
+    p_inst->src_reg[1] = rec.src_reg[1];
     return true;
 }
 
+//
+// trace_has_instructions
+//
+//  returns true if the trace has at least count instructions, looking
+//  ahead of read_instruction if need be
+//
+bool trace_has_instructions(uint64_t count)
+{
+    if (traceReplay) {
+        return traceReplay->hasAtLeast(count);
+    }
+    return traceReader.hasAtLeast(count);
+}
+
+//
+// parse_fu_timing
+//
+//  reads -L or -I: values for the FU types in order, or op=N for a trace
+//  op code; returns false if the list is malformed
+//
+bool parse_fu_timing(const char* list, int* per_type, int* per_op)
+{
+    int t = 0;
+    for (const char* p = list; ; p++) {
+        char* end;
+        long v = strtol(p, &end, 10);
+        if (end == p)
+            return false;
+        if (*end == '=') {
+            if (v < -1 || v > 2)
+                return false;
+            long op = v;
+            p = end + 1;
+            v = strtol(p, &end, 10);
+            if (end == p || v < 1)
+                return false;
+            per_op[op + 1] = v;
+        } else {
+            if (t == 3 || v < 1)
+                return false;
+            per_type[t++] = v;
+        }
+        p = end;
+        if (*p == '\0')
+            return true;
+        if (*p != ',')
+            return false;
+    }
+}
+
+//
+// parse_positive
+//
+//  reads a count such as -f or -R into value; returns false unless it is a
+//  whole number of at least 1
+//
+bool parse_positive(const char* text, int* value)
+{
+    char* end;
+    long v = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || v < 1 || v > INT_MAX)
+        return false;
+    *value = static_cast<int>(v);
+    return true;
+}
+
+//
+// close_traces
+//
+//  closes the files opened for -i, at exit
+//
+void close_traces(void)
+{
+    for (FILE* file : inFiles)
+        fclose(file);
+    inFiles.clear();
+}
+
+//
+// replay_threads
+//
+//  makes a source for each thread's trace, kept in sources, and returns
+//  them as a Processor takes them
+//
+std::vector<InstructionSource*> replay_threads(const std::vector<std::vector<trace_record_t> >& records,
+                                               std::vector<std::unique_ptr<TraceBufferSource> >& sources)
+{
+    std::vector<InstructionSource*> threads;
+    for (auto& trace : records) {
+        sources.emplace_back(new TraceBufferSource(trace));
+        threads.push_back(sources.back().get());
+    }
+    return threads;
+}
+
 void print_statistics(proc_stats_t* p_stats);
+void print_thread_stats(const std::vector<proc_thread_stats_t>& threads,
+                        const std::vector<std::string>& traces, proc_stats_t* p_stats);
+void print_utilization(proc_util_t* p_util);
+void print_branch_stats(proc_branch_stats_t* p_branch, proc_stats_t* p_stats, proc_stats_t* p_perfect);
+#ifdef PROCSIM_PROFILE
+void print_profile(proc_profile_t* p_profile, proc_stats_t* p_stats);
+#endif
+long peak_rss_kb(void);
+
+// Names of the CDB policies for -c, in CdbPolicy order
+const char* cdb_policy_names[] = {"wait", "oldest", "rr"};
+
+// Names of the timeline formats for -t, in TimelineFormat order
+const char* timeline_format_names[] = {"text", "none", "binary", "gzip"};
+
+// Names of the branch predictors for -b, in BranchPredictorKind order,
+// and of the recoveries for -B, in BranchRecovery order
+const char* predictor_names[] = {"perfect", "taken", "nottaken", "cbp"};
+const char* recovery_names[] = {"redirect", "stall"};
+
+// Names of the SMT fetch policies for -F, in FetchPolicy order
+const char* fetch_policy_names[] = {"rr", "icount"};
 
 int main(int argc, char* argv[]) {
     int opt;
@@ -52,32 +229,206 @@ int main(int argc, char* argv[]) {
     uint64_t k1 = DEFAULT_K1;
     uint64_t k2 = DEFAULT_K2;
     uint64_t r = DEFAULT_R;
+    proc_options_t options;
+    TimelineFormat timeline_format = TIMELINE_TEXT;
+    const char* timeline_path = nullptr;
+    bool timeline_set = false;
+    bool sweep = false;
+    bool utilization = false;
+    bool measure = false;
+    bool timing = false;
+    sweep_spec_t spec;
+    sampling_spec_t sampling;
+    sampling.period = 0;
+    sampling.warmup = 2000;
+    sampling.measure = 1000;
+    spec.threads = 0;
+    spec.results = spec.minimal = nullptr;
+    const char* values[5] = {STRINGIFY(DEFAULT_R), STRINGIFY(DEFAULT_K0), STRINGIFY(DEFAULT_K1),
+                             STRINGIFY(DEFAULT_K2), STRINGIFY(DEFAULT_F)}; // -r, -j, -k, -l, -f
+
+    atexit(close_traces);
 
     /* Read arguments */ 
-    while(-1 != (opt = getopt(argc, argv, "r:i:j:k:l:f:h"))) {
+    while(-1 != (opt = getopt(argc, argv, "r:i:j:k:l:f:c:b:B:p:L:I:R:C:P:F:t:O:uMs:w:ST:o:m:h"))) {
         switch(opt) {
         case 'r':
-            r = atoi(optarg);
+            values[0] = optarg;
             break;
         case 'j':
-            k0 = atoi(optarg);
+            values[1] = optarg;
             break;
         case 'k':
-            k1 = atoi(optarg);
+            values[2] = optarg;
             break;
         case 'l':
-            k2 = atoi(optarg);
+            values[3] = optarg;
             break;
         case 'f':
-            f = atoi(optarg);
+            values[4] = optarg;
+            break;
+        case 't':
+            for (int p = 0; ; p++)
+            {
+                if (p == 4)
+                {
+                    fprintf(stderr, "Unknown timeline format %s\n", optarg);
+                    print_help_and_exit();
+                }
+                if (strcmp(optarg, timeline_format_names[p]) == 0)
+                {
+                    timeline_format = static_cast<TimelineFormat>(p);
+                    timeline_set = true;
+                    break;
+                }
+            }
+            break;
+        case 'O':
+            timeline_path = optarg;
+            break;
+        case 'u':
+            utilization = true;
+            break;
+        case 'M':
+            measure = true;
+            break;
+        case 's':
+            sampling.period = strtoull(optarg, NULL, 10);
+            break;
+        case 'w':
+        {
+            char* end;
+            sampling.warmup = strtoull(optarg, &end, 10);
+            if (*end != ',' || (sampling.measure = strtoull(end + 1, &end, 10)) == 0 || *end != '\0')
+            {
+                fprintf(stderr, "Bad sample window %s\n", optarg);
+                print_help_and_exit();
+            }
+            break;
+        }
+        case 'S':
+            sweep = true;
+            break;
+        case 'T':
+            spec.threads = atoi(optarg);
+            break;
+        case 'o':
+            spec.results = optarg;
+            break;
+        case 'm':
+            spec.minimal = optarg;
             break;
         case 'i':
-            inFile = fopen(optarg, "r");
-            if (inFile == NULL)
+        {
+            spec.traces.push_back(optarg);
+            FILE* file = fopen(optarg, "r");
+            if (file == NULL)
             {
                 fprintf(stderr, "Failed to open %s for reading\n", optarg);
                 print_help_and_exit();
             }
+            inFiles.push_back(file);
+            break;
+        }
+        case 'c':
+            for (int p = 0; ; p++)
+            {
+                if (p == 3)
+                {
+                    fprintf(stderr, "Unknown CDB policy %s\n", optarg);
+                    print_help_and_exit();
+                }
+                if (strcmp(optarg, cdb_policy_names[p]) == 0)
+                {
+                    options.cdb_policy = static_cast<CdbPolicy>(p);
+                    break;
+                }
+            }
+            break;
+        case 'b':
+            for (int p = 0; ; p++)
+            {
+                if (p == 4)
+                {
+                    fprintf(stderr, "Unknown branch predictor %s\n", optarg);
+                    print_help_and_exit();
+                }
+                if (strcmp(optarg, predictor_names[p]) == 0)
+                {
+                    options.predictor = static_cast<BranchPredictorKind>(p);
+                    break;
+                }
+            }
+            break;
+        case 'B':
+            for (int p = 0; ; p++)
+            {
+                if (p == 2)
+                {
+                    fprintf(stderr, "Unknown misprediction recovery %s\n", optarg);
+                    print_help_and_exit();
+                }
+                if (strcmp(optarg, recovery_names[p]) == 0)
+                {
+                    options.branch_recovery = static_cast<BranchRecovery>(p);
+                    break;
+                }
+            }
+            break;
+        case 'p':
+            options.mispredict_penalty = atoi(optarg);
+            break;
+        case 'L':
+            if (!parse_fu_timing(optarg, options.fu_latency, options.op_latency))
+            {
+                fprintf(stderr, "Bad list of latencies %s\n", optarg);
+                print_help_and_exit();
+            }
+            timing = true;
+            break;
+        case 'I':
+            if (!parse_fu_timing(optarg, options.fu_interval, options.op_interval))
+            {
+                fprintf(stderr, "Bad list of initiation intervals %s\n", optarg);
+                print_help_and_exit();
+            }
+            timing = true;
+            break;
+        case 'F':
+            for (int p = 0; ; p++)
+            {
+                if (p == 2)
+                {
+                    fprintf(stderr, "Unknown fetch policy %s\n", optarg);
+                    print_help_and_exit();
+                }
+                if (strcmp(optarg, fetch_policy_names[p]) == 0)
+                {
+                    options.fetch_policy = static_cast<FetchPolicy>(p);
+                    break;
+                }
+            }
+            break;
+        case 'R':
+            if (!parse_positive(optarg, &options.rob_size))
+            {
+                fprintf(stderr, "Bad reorder buffer size %s\n", optarg);
+                print_help_and_exit();
+            }
+            break;
+        case 'C':
+            if (!parse_positive(optarg, &options.commit_width))
+            {
+                fprintf(stderr, "Bad commit width %s\n", optarg);
+                print_help_and_exit();
+            }
+            break;
+        case 'P':
+            if (!parse_positive(optarg, &options.rename_regs))
+            {
+                fprintf(stderr, "Bad number of rename registers %s\n", optarg);
+                print_help_and_exit();
+            }
             break;
         case 'h':
             /* Fall through */
@@ -87,16 +438,132 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    if (sweep)
+    {
+        std::vector<uint64_t>* lists[5] = {&spec.r, &spec.k0, &spec.k1, &spec.k2, &spec.f};
+        for (int p = 0; p < 5; p++)
+        {
+            if (!parse_sweep_values(values[p], *lists[p]))
+            {
+                fprintf(stderr, "Bad list of values %s\n", values[p]);
+                print_help_and_exit();
+            }
+        }
+        for (int a = optind; a < argc; a++)
+            spec.traces.push_back(argv[a]);
+        if (spec.traces.empty() || (spec.results == nullptr && spec.minimal == nullptr))
+            print_help_and_exit();
+        spec.options = options;
+        return run_sweep(spec);
+    }
+
+    /* Otherwise each is one count */
+    uint64_t* counts[5] = {&r, &k0, &k1, &k2, &f};
+    for (int p = 0; p < 5; p++)
+    {
+        int value;
+        if (!parse_positive(values[p], &value))
+        {
+            fprintf(stderr, "Bad -%c %s\n", "rjklf"[p], values[p]);
+            print_help_and_exit();
+        }
+        *counts[p] = value;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    /* Several traces are threads of one processor; each is read into
+       memory first */
+    bool smt = spec.traces.size() > 1;
+    if (sampling.period != 0 && (smt || sampling.period < sampling.warmup + sampling.measure))
+    {
+        fprintf(stderr, "Sampling takes one trace and a period of at least the window\n");
+        print_help_and_exit();
+    }
+    if (sampling.period != 0 && (timeline_set || timeline_path != nullptr || utilization))
+    {
+        fprintf(stderr, "Sampling prints neither a timeline nor utilization: -t, -O and -u don't go with -s\n");
+        print_help_and_exit();
+    }
+    std::vector<std::vector<trace_record_t> > thread_records(smt ? spec.traces.size() : 0);
+    for (size_t t = 0; t < thread_records.size(); t++)
+        load_trace(inFiles[t], thread_records[t]);
+    if (!smt)
+        traceReader.open(inFiles.empty() ? stdin : inFiles[0]);
+
     printf("Processor Settings\n");
     printf("R: %" PRIu64 "\n", r);
     printf("k0: %" PRIu64 "\n", k0);
     printf("k1: %" PRIu64 "\n", k1);
     printf("k2: %" PRIu64 "\n", k2);
     printf("F: %"  PRIu64 "\n", f);
+    if (options.cdb_policy != CDB_LONGEST_WAIT)
+        printf("CDB policy: %s\n", cdb_policy_names[options.cdb_policy]);
+    if (timing)
+    {
+        printf("Latency/interval:");
+        for (int t = 0; t < 3; t++)
+            printf(" k%d %d/%d", t, options.fu_latency[t], options.fu_interval[t]);
+        for (int op = -1; op < 3; op++)
+            if (options.op_latency[op + 1] || options.op_interval[op + 1])
+                printf(" op%d %d/%d", op, options.op_latency[op + 1] ? options.op_latency[op + 1] : options.fu_latency[op == -1 ? 1 : op],
+                       options.op_interval[op + 1] ? options.op_interval[op + 1] : options.fu_interval[op == -1 ? 1 : op]);
+        printf("\n");
+    }
+    if (options.rob_size > 0)
+        printf("ROB: %d entries, commit width %d, %d rename registers\n", options.rob_size,
+               options.commit_width > 0 ? options.commit_width : static_cast<int>(f),
+               options.rename_regs > 0 ? options.rename_regs : options.rob_size);
+    if (options.predictor != BP_PERFECT)
+        printf("Branch predictor: %s (%s, penalty %d)\n", predictor_names[options.predictor],
+               recovery_names[options.branch_recovery], options.mispredict_penalty);
+    if (smt)
+        printf("Threads: %zu (fetch policy %s)\n", spec.traces.size(), fetch_policy_names[options.fetch_policy]);
+    if (sampling.period != 0)
+        printf("Sampling: every %" PRIu64 " instructions, %" PRIu64 " of warm-up and %" PRIu64 " measured\n",
+               sampling.period, sampling.warmup, sampling.measure);
     printf("\n");
 
+    if (sampling.period != 0) {
+        sampling.r = r;
+        sampling.k0 = k0;
+        sampling.k1 = k1;
+        sampling.k2 = k2;
+        sampling.f = f;
+        sampling.options = options;
+        return run_sampling(sampling, traceReader);
+    }
+
+    /* What a predictor costs is measured against perfect prediction, so
+       read the trace into memory and run it that way first */
+    proc_stats_t perfect_stats;
+    if (options.predictor != BP_PERFECT) {
+        proc_options_t perfect_options = options;
+        perfect_options.predictor = BP_PERFECT;
+        Processor perfect(r, k0, k1, k2, f, perfect_options);
+        if (smt) {
+            std::vector<std::unique_ptr<TraceBufferSource> > sources;
+            perfect.run(replay_threads(thread_records, sources), nullptr);
+        } else {
+            trace_record_t rec;
+            while (traceReader.next(&rec))
+                traceRecords.push_back(rec);
+            traceReplay.reset(new TraceBufferSource(traceRecords));
+
+            TraceBufferSource source(traceRecords);
+            perfect.run(source, nullptr);
+        }
+        perfect.complete(&perfect_stats);
+    }
+
     /* Setup the processor */
+    if (timeline_format != TIMELINE_TEXT || timeline_path != nullptr)
+        set_proc_timeline(open_timeline(timeline_format, timeline_path));
+    set_proc_options(&options);
     setup_proc(r, k0, k1, k2, f);
+    std::vector<std::unique_ptr<TraceBufferSource> > thread_sources;
+    if (smt)
+        set_proc_threads(replay_threads(thread_records, thread_sources));
 
     /* Setup statistics */
     proc_stats_t stats;
@@ -110,9 +577,69 @@ int main(int argc, char* argv[]) {
 
     print_statistics(&stats);
 
+    if (smt) {
+        std::vector<proc_thread_stats_t> threads;
+        thread_stats_proc(&threads);
+        print_thread_stats(threads, spec.traces, &stats);
+    }
+
+    if (utilization) {
+        proc_util_t util;
+        utilization_proc(&util);
+        print_utilization(&util);
+    }
+
+    if (options.predictor != BP_PERFECT) {
+        proc_branch_stats_t branch;
+        branch_stats_proc(&branch);
+        print_branch_stats(&branch, &stats, &perfect_stats);
+    }
+
+#ifdef PROCSIM_PROFILE
+    proc_profile_t profile;
+    profile_proc(&profile);
+    print_profile(&profile, &stats);
+#endif
+
+    /* With -M, how fast it simulated, on stderr as with -S and -s */
+    if (measure) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        fprintf(stderr, "%lu instructions in %.3f s (%.1f KIPS), peak RSS %ld KB\n", stats.retired_instruction,
+                seconds, stats.retired_instruction / seconds / 1000, peak_rss_kb());
+    }
+
     return 0;
 }
 
+//
+// peak_rss_kb
+//
+// The most memory procsim has had resident, in kilobytes.  On Linux it's
+// read from /proc, since getrusage's figure carries over what the process
+// that started procsim had before exec.
+//
+long peak_rss_kb(void) {
+    long kb = -1;
+    FILE* status = fopen("/proc/self/status", "r");
+    if (status != NULL) {
+        char line[256];
+        while (fgets(line, sizeof(line), status) != NULL)
+            if (sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+                break;
+        fclose(status);
+    }
+    if (kb < 0) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        kb = usage.ru_maxrss / 1024;
+#else
+        kb = usage.ru_maxrss;
+#endif
+    }
+    return kb;
+}
+
 void print_statistics(proc_stats_t* p_stats) {
     printf("Processor stats:\n");
 	printf("Total instructions: %lu\n", p_stats->retired_instruction);
@@ -123,3 +650,95 @@ void print_statistics(proc_stats_t* p_stats) {
 	printf("Total run time (cycles): %lu\n", p_stats->cycle_count);
 }
 
+void print_thread_stats(const std::vector<proc_thread_stats_t>& threads,
+                        const std::vector<std::string>& traces, proc_stats_t* p_stats) {
+    printf("\nThreads (IPC over the whole run, and until each finished):\n");
+    for (size_t t = 0; t < threads.size(); t++) {
+        printf("%zu %s: %" PRIu64 " instructions, IPC %f, done in %" PRIu64 " cycles (IPC %f)\n",
+               t, traces[t].c_str(), threads[t].instructions,
+               static_cast<double>(threads[t].instructions) / p_stats->cycle_count, threads[t].cycles,
+               threads[t].cycles ? static_cast<double>(threads[t].instructions) / threads[t].cycles : 0.0);
+    }
+    printf("Combined IPC: %f\n", static_cast<double>(p_stats->retired_instruction) / p_stats->cycle_count);
+}
+
+// One histogram: its mean and the cycles spent at each nonzero count
+void print_histogram(const char* name, const std::vector<uint64_t>& histogram, uint64_t cycles) {
+    printf("%s: mean %.3f of %zu\n", name, util_mean(histogram), histogram.size() - 1);
+    for (size_t n = 0; n < histogram.size(); n++) {
+        if (histogram[n] != 0)
+            printf("  %zu\t%" PRIu64 "\t%.2f%%\n", n, histogram[n], 100.0 * histogram[n] / cycles);
+    }
+}
+
+void print_utilization(proc_util_t* p_util) {
+    printf("\nUtilization (busy, cycles, share of %" PRIu64 " cycles):\n", p_util->cycles);
+    print_histogram("k0 FUs", p_util->fu_busy[0], p_util->cycles);
+    print_histogram("k1 FUs", p_util->fu_busy[1], p_util->cycles);
+    print_histogram("k2 FUs", p_util->fu_busy[2], p_util->cycles);
+    print_histogram("Result buses", p_util->cdb_busy, p_util->cycles);
+    print_histogram("RS entries", p_util->rs_busy, p_util->cycles);
+    if (p_util->rob_busy.size() > 1)
+        print_histogram("ROB entries", p_util->rob_busy, p_util->cycles);
+    printf("Stalls (instruction-cycles):\n");
+    printf("  Source not ready: %" PRIu64 "\n", p_util->stall_source);
+    printf("  No FU of its type free: %" PRIu64 "\n", p_util->stall_fu);
+    printf("  No result bus free: %" PRIu64 "\n", p_util->stall_cdb);
+    printf("  No RS entry to dispatch into: %" PRIu64 "\n", p_util->stall_rs_full);
+    if (p_util->rob_busy.size() > 1) {
+        printf("  No ROB entry: %" PRIu64 "\n", p_util->stall_rob_full);
+        printf("  No physical register: %" PRIu64 "\n", p_util->stall_regs_full);
+    }
+    printf("Fetch slots lost to a full RS: %" PRIu64 "\n", p_util->fetch_lost);
+}
+
+void print_branch_stats(proc_branch_stats_t* p_branch, proc_stats_t* p_stats, proc_stats_t* p_perfect) {
+    double ipc = static_cast<double>(p_stats->retired_instruction) / p_stats->cycle_count;
+    double perfect_ipc = static_cast<double>(p_perfect->retired_instruction) / p_perfect->cycle_count;
+    printf("\nBranch prediction:\n");
+    printf("Branches: %" PRIu64 "\n", p_branch->branches);
+    printf("Mispredicted: %" PRIu64 " (%.2f%%, %.2f per 1000 instructions)\n", p_branch->mispredicts,
+           p_branch->branches ? 100.0 * p_branch->mispredicts / p_branch->branches : 0.0,
+           1000.0 * p_branch->mispredicts / p_stats->retired_instruction);
+    printf("Fetch cycles lost: %" PRIu64 "\n", p_branch->fetch_lost);
+    printf("IPC with perfect prediction: %f\n", perfect_ipc);
+    printf("IPC lost to mispredictions: %f (%.2f%%)\n", perfect_ipc - ipc,
+           100.0 * (perfect_ipc - ipc) / perfect_ipc);
+}
+
+#ifdef PROCSIM_PROFILE
+//
+// print_profile
+//
+// Host time per simulated cycle and simulated instructions per host second
+// for each stage of the simulation loop, then for the whole loop
+//
+void print_profile(proc_profile_t* p_profile, proc_stats_t* p_stats) {
+    uint64_t total = 0;
+    for (int s = 0; s < NUM_PROF_STAGES; s++)
+        total += p_profile->ticks[s];
+    printf("\nSimulator profile (host time):\n");
+    printf("%-16s %12s %12s %8s\n", "Stage", "ns/cycle", "KIPS", "Share");
+    for (int s = 0; s <= NUM_PROF_STAGES; s++) {
+        uint64_t ticks = s < NUM_PROF_STAGES ? p_profile->ticks[s] : total;
+        double ns = ticks * p_profile->ns_per_tick;
+        printf("%-16s %12.2f %12.1f %7.2f%%\n", s < NUM_PROF_STAGES ? profile_stage_names[s] : "total",
+               ns / p_stats->cycle_count, ns > 0 ? 1e6 * p_stats->retired_instruction / ns : 0.0,
+               total ? 100.0 * ticks / total : 0.0);
+    }
+    if (p_profile->host_cycles < 0 && p_profile->host_instructions < 0) {
+        printf("Host counters: unavailable (perf_event_open refused)\n");
+        return;
+    }
+    if (p_profile->host_cycles >= 0)
+        printf("Host cycles: %" PRId64 " (%.1f per simulated cycle)\n", p_profile->host_cycles,
+               static_cast<double>(p_profile->host_cycles) / p_stats->cycle_count);
+    if (p_profile->host_instructions >= 0)
+        printf("Host instructions: %" PRId64 " (%.1f per simulated instruction)\n", p_profile->host_instructions,
+               static_cast<double>(p_profile->host_instructions) / p_stats->retired_instruction);
+    if (p_profile->host_branch_misses >= 0)
+        printf("Host branch misses: %" PRId64 "\n", p_profile->host_branch_misses);
+    if (p_profile->host_cache_misses >= 0)
+        printf("Host cache misses: %" PRId64 "\n", p_profile->host_cache_misses);
+}
+#endif
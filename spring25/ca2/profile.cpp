@@ -0,0 +1,80 @@
+// profile.cpp
+#include "profile.hpp"
+#include <cstring>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char *const profile_stage_names[NUM_PROF_STAGES] = {
+        "execute", "update RF", "issue", "dispatch", "fetch", "utilization",
+        "dispatch stats", "broadcast", "retire", "commit", "skip"};
+
+#ifdef __linux__
+static const uint64_t perfEvents[4] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+#endif
+
+PerfCounters::PerfCounters()
+{
+        for (int c = 0; c < 4; c++)
+        {
+                fds[c] = -1;
+#ifdef __linux__
+                // Only this thread's user-mode counts, which an
+                // unprivileged process is usually allowed
+                struct perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.size = sizeof(attr);
+                attr.config = perfEvents[c];
+                attr.disabled = 1;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                fds[c] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+        }
+}
+
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+        for (int c = 0; c < 4; c++)
+                if (fds[c] >= 0)
+                        close(fds[c]);
+#endif
+}
+
+void PerfCounters::start()
+{
+#ifdef __linux__
+        for (int c = 0; c < 4; c++)
+                if (fds[c] >= 0)
+                {
+                        ioctl(fds[c], PERF_EVENT_IOC_RESET, 0);
+                        ioctl(fds[c], PERF_EVENT_IOC_ENABLE, 0);
+                }
+#endif
+}
+
+void PerfCounters::stop(proc_profile_t *profile)
+{
+        int64_t *counts[4] = {&profile->host_cycles, &profile->host_instructions,
+                              &profile->host_branch_misses, &profile->host_cache_misses};
+        for (int c = 0; c < 4; c++)
+        {
+                *counts[c] = -1;
+#ifdef __linux__
+                uint64_t count;
+                if (fds[c] >= 0)
+                {
+                        ioctl(fds[c], PERF_EVENT_IOC_DISABLE, 0);
+                        if (read(fds[c], &count, sizeof(count)) == sizeof(count))
+                                *counts[c] = static_cast<int64_t>(count);
+                }
+#endif
+        }
+}
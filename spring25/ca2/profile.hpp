@@ -0,0 +1,79 @@
+// profile.hpp
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include <cstdint>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Where procsim itself spends its time: the host time taken by each call
+// of the simulation loop, for finding which stage limits how fast it
+// simulates.  Processor::run only keeps it when built with
+// PROCSIM_PROFILE defined (make PROFILE=1); otherwise nothing is timed.
+enum ProfileStage
+{
+    PROF_EXECUTE = 0,
+    PROF_UPDATE_RF,
+    PROF_ISSUE,
+    PROF_DISPATCH,
+    PROF_FETCH,
+    PROF_UTILIZATION,    // sampling utilization
+    PROF_DISPATCH_STATS,
+    PROF_BROADCAST,
+    PROF_RETIRE,
+    PROF_COMMIT,
+    PROF_SKIP,           // finding and skipping to the next busy cycle
+    NUM_PROF_STAGES
+};
+
+// Stage names for printing, indexed by ProfileStage
+extern const char *const profile_stage_names[NUM_PROF_STAGES];
+
+typedef struct _proc_profile_t
+{
+    uint64_t ticks[NUM_PROF_STAGES]; // profile_ticks() spent in each stage
+    double ns_per_tick;              // measured over the run
+    // The host's hardware counters over the whole run, from perf_event;
+    // -1 for those the kernel wouldn't open
+    int64_t host_cycles;
+    int64_t host_instructions;
+    int64_t host_branch_misses;
+    int64_t host_cache_misses;
+} proc_profile_t;
+
+// A timestamp cheap enough to take around every stage: the time stamp
+// counter on x86, nanoseconds elsewhere
+static inline uint64_t profile_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// The calling thread's host cycles, instructions, branch misses and cache
+// misses, counted with perf_event_open where the kernel allows it.
+// Reading one is a system call, so they're read once for a whole run
+// rather than around each stage.
+class PerfCounters
+{
+public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    // Zeroes the counters and starts them counting
+    void start();
+    // Stops them and copies them into profile
+    void stop(proc_profile_t *profile);
+
+private:
+    int fds[4];
+};
+
+#endif // PROFILE_HPP
@@ -0,0 +1,263 @@
+#!/usr/bin/env python3
+"""
+regress.py
+
+Checks that procsim still simulates exactly what it did: runs it over a
+matrix of traces and configurations and compares every timeline row and
+every statistic with golden outputs, reporting for each case that
+differs where its timeline first changed.
+
+The goldens are kept in the repo, in regress/golden/, one small text
+file per case: a hash of each block of BLOCK_ROWS timeline rows, and
+every other line (settings and statistics) as it is.  A changed block
+is reported by the instructions it holds; given a build known to be
+right with -r, the case is rerun on it to find the exact instruction and
+stage.  The reference outputs kept in the repo (output1.1/*.output and
+my_trace.output) are checked row by row as well.
+
+When a change to the simulator is meant to change its output, record the
+goldens again from the changed build (make golden) and commit them.
+
+Usage:
+  $ python3 regress.py -p ./procsim                      # check
+  $ python3 regress.py -p ./procsim -r ./procsim.good    # and pinpoint
+  $ python3 regress.py --update -p ./procsim             # record
+"""
+
+import argparse
+import hashlib
+import os
+import subprocess
+import sys
+from concurrent.futures import ThreadPoolExecutor
+
+TRACES_DIR = "traces"
+REGRESS_DIR = "./regress"
+GOLDEN_DIR = "./regress/golden"
+# Timeline rows hashed together in a golden
+BLOCK_ROWS = 1000
+TRACES = ["gcc", "gobmk", "hmmer", "mcf"]
+# Traces of a few fetch groups, kept in REGRESS_DIR, whose lengths aren't
+# a multiple of most fetch widths below; they're run on every
+# configuration as well
+SHORT_TRACES = ["gcc.13"]
+
+# Configurations run on every trace, by name.  Together they cover each
+# option that changes the timeline; -u adds the utilization statistics.
+CONFIGS = [
+    ("base", "-r2 -j3 -k2 -l1 -f4"),
+    ("narrow", "-r1 -j1 -k1 -l1 -f1"),
+    ("wide", "-r8 -j2 -k2 -l2 -f8 -u"),
+    ("window", "-r16 -j64 -k64 -l64 -f16 -u"),
+    ("cdb-oldest", "-r2 -j2 -k2 -l2 -f4 -c oldest"),
+    ("cdb-rr", "-r2 -j2 -k2 -l2 -f4 -c rr"),
+    # Long latencies leave idle cycles to skip, which round-robin has to
+    # turn through all the same
+    ("cdb-rr-latency", "-r2 -L 2,4,8 -c rr"),
+    ("cbp", "-r4 -j2 -k2 -l2 -f4 -b cbp -p 2 -u"),
+    ("taken-stall", "-r4 -j2 -k2 -l2 -f4 -b taken -B stall -p 3"),
+    ("latency", "-r4 -j2 -k2 -l2 -f4 -L 3,1,5 -I 1,1,5 -u"),
+    ("rob", "-r4 -j2 -k2 -l2 -f4 -R 16 -C 2 -P 8 -u"),
+]
+
+# Traces run together as SMT threads, with their configurations
+SMT_CASES = [
+    ("smt-rr", ["gcc", "mcf"], "-r4 -j2 -k2 -l2 -f4 -u"),
+    ("smt-icount", ["hmmer", "gobmk", "gcc"], "-r8 -j3 -k3 -l3 -f8 -F icount -R 32 -b cbp -u"),
+]
+
+# The reference outputs in the repo, and the configuration they came from
+REFERENCES = [(f"output1.1/{t}.output", t) for t in TRACES] + [("my_trace.output", "gcc")]
+REFERENCE_CONFIG = "-r2 -j3 -k2 -l1 -f4"
+
+
+def cases():
+    """
+    Every case as (name, procsim arguments, golden file); the golden file
+    is a summary under GOLDEN_DIR, or a reference output in the repo.
+    """
+    traces = [(t, os.path.join(TRACES_DIR, f"{t}.100k.trace")) for t in TRACES] + \
+        [(t, os.path.join(REGRESS_DIR, f"{t}.trace")) for t in SHORT_TRACES]
+    for trace, path in traces:
+        for name, args in CONFIGS:
+            yield f"{trace}/{name}", args.split() + ["-i", path], \
+                os.path.join(GOLDEN_DIR, f"{trace}.{name}.golden")
+    for name, traces, args in SMT_CASES:
+        inputs = []
+        for trace in traces:
+            inputs += ["-i", os.path.join(TRACES_DIR, f"{trace}.100k.trace")]
+        yield f"{'+'.join(traces)}/{name}", args.split() + inputs, \
+            os.path.join(GOLDEN_DIR, f"{'+'.join(traces)}.{name}.golden")
+    for reference, trace in REFERENCES:
+        yield reference, REFERENCE_CONFIG.split() + ["-i", os.path.join(TRACES_DIR, f"{trace}.100k.trace")], \
+            reference
+
+
+def run_procsim(procsim, args):
+    """
+    procsim's output for args
+    """
+    proc = subprocess.run([procsim] + args, capture_output=True, text=True)
+    if proc.returncode != 0:
+        raise RuntimeError(f"procsim {' '.join(args)} exited with {proc.returncode}: {proc.stderr.strip()}")
+    return proc.stdout
+
+
+def read_file(path):
+    with open(path) as f:
+        return f.read()
+
+
+def split_output(text):
+    """
+    procsim's output as its timeline header, its timeline rows and every
+    other line (settings and statistics), with trailing whitespace
+    dropped: some reference outputs end rows with a tab and some don't.
+    """
+    header, rows, stats = None, [], []
+    for line in text.splitlines():
+        line = line.rstrip()
+        if header is None and line.startswith("INST"):
+            header = line.split()
+        elif header is not None and line[:1].isdigit() and len(line.split()) == len(header):
+            rows.append(line)
+        else:
+            stats.append(line)
+    return header or [], rows, stats
+
+
+def compare(golden, actual):
+    """
+    None if the outputs match, else what differs first: the instruction
+    and stage for a timeline row, or the statistic
+    """
+    header, golden_rows, golden_stats = split_output(golden)
+    _, rows, stats = split_output(actual)
+    for n, row in enumerate(rows[:len(golden_rows)]):
+        if row != golden_rows[n]:
+            want, got = golden_rows[n].split(), row.split()
+            stage = next(s for s in range(len(want)) if want[s] != got[s])
+            return (f"row {n + 1} (instruction {want[0]}) differs first at {header[stage]}: "
+                    f"golden {want[stage]}, now {got[stage]}\n"
+                    f"    golden: {' '.join(want)}\n    now:    {' '.join(got)}")
+    if len(rows) != len(golden_rows):
+        return f"{len(rows)} timeline rows instead of {len(golden_rows)}"
+    for want, got in zip(golden_stats, stats):
+        if want != got:
+            return f"statistics differ:\n    golden: {want}\n    now:    {got}"
+    if len(stats) != len(golden_stats):
+        return f"{len(stats)} lines of settings and statistics instead of {len(golden_stats)}"
+    return None
+
+
+def block_hash(rows):
+    return hashlib.sha1("\n".join(rows).encode()).hexdigest()[:16]
+
+
+def summarize(text):
+    """
+    The golden of procsim's output: the number of timeline rows, their
+    header, a hash of each BLOCK_ROWS of them, and every other line
+    """
+    header, rows, stats = split_output(text)
+    lines = [f"rows\t{len(rows)}", "header\t" + " ".join(header)]
+    for first in range(0, len(rows), BLOCK_ROWS):
+        lines.append(f"block\t{first}\t{block_hash(rows[first:first + BLOCK_ROWS])}")
+    lines += ["stat\t" + line for line in stats]
+    return "\n".join(lines) + "\n"
+
+
+def compare_summary(golden, actual):
+    """
+    None if actual matches the golden summary, else what differs first:
+    the block of timeline rows, by the instructions in it, or the statistic
+    """
+    count, header, blocks, golden_stats = 0, [], [], []
+    for line in golden.splitlines():
+        kind, _, value = line.partition("\t")
+        if kind == "rows":
+            count = int(value)
+        elif kind == "header":
+            header = value.split()
+        elif kind == "block":
+            blocks.append(value.split("\t")[1])
+        elif kind == "stat":
+            golden_stats.append(value)
+    now_header, rows, stats = split_output(actual)
+    if now_header != header:
+        return f"timeline header is {' '.join(now_header)} instead of {' '.join(header)}"
+    for b, want in enumerate(blocks):
+        block = rows[b * BLOCK_ROWS:(b + 1) * BLOCK_ROWS]
+        if block and block_hash(block) != want:
+            return (f"rows {b * BLOCK_ROWS + 1}-{b * BLOCK_ROWS + len(block)} (instructions "
+                    f"{block[0].split()[0]} to {block[-1].split()[0]}) differ")
+    if len(rows) != count:
+        return f"{len(rows)} timeline rows instead of {count}"
+    for want, got in zip(golden_stats, stats):
+        if want != got:
+            return f"statistics differ:\n    golden: {want}\n    now:    {got}"
+    if len(stats) != len(golden_stats):
+        return f"{len(stats)} lines of settings and statistics instead of {len(golden_stats)}"
+    return None
+
+
+def check(procsim, reference, case):
+    name, args, golden_path = case
+    if not os.path.exists(golden_path):
+        return name, "no golden output (record them with --update)"
+    try:
+        output = run_procsim(procsim, args)
+        if not golden_path.startswith(GOLDEN_DIR):
+            return name, compare(read_file(golden_path), output)
+        problem = compare_summary(read_file(golden_path), output)
+        if problem is not None and reference is not None:
+            # The build known to be right has the rows the golden only hashes
+            detail = compare(run_procsim(reference, args), output)
+            if detail is not None:
+                problem += "\n  " + detail
+        return name, problem
+    except RuntimeError as e:
+        return name, str(e)
+
+
+def update(procsim, reference, case):
+    name, args, golden_path = case
+    with open(golden_path, "w") as f:
+        f.write(summarize(run_procsim(procsim, args)))
+    return name, None
+
+
+def main():
+    parser = argparse.ArgumentParser(description="procsim golden-output regression suite")
+    parser.add_argument("-p", "--procsim", default="./procsim", help="simulator to check")
+    parser.add_argument("-r", "--reference",
+                        help="a build known to be right, rerun to find where a case first differs")
+    parser.add_argument("--update", action="store_true",
+                        help="record the golden outputs from this procsim instead of checking")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count(), help="cases run at once")
+    args = parser.parse_args()
+
+    todo = list(cases())
+    if args.update:
+        os.makedirs(GOLDEN_DIR, exist_ok=True)
+        todo = [case for case in todo if case[2].startswith(GOLDEN_DIR)]
+    work = update if args.update else check
+    failed = 0
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        for name, problem in pool.map(lambda case: work(args.procsim, args.reference, case), todo):
+            if problem is None:
+                print(f"ok    {name}")
+            else:
+                failed += 1
+                print(f"FAIL  {name}: {problem}")
+            sys.stdout.flush()
+
+    if args.update:
+        print(f"Recorded {len(todo)} golden outputs in {GOLDEN_DIR}")
+    else:
+        print(f"{len(todo) - failed} of {len(todo)} cases match")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,7 +1,6 @@
 #!/usr/bin/env python3
 import os
 import subprocess
-import itertools
 
 # Directory containing your trace files
 traces_dir = "./traces"
@@ -20,30 +19,24 @@ result_buses = [1, 2, 4, 8] # Number of result buses R; adjust as needed
 sim_executable = "./procsim"
 
 # Find all .trace files in the traces directory
-trace_files = [f for f in os.listdir(traces_dir) if f.endswith(".trace")]
-
-# Loop over each trace and each combination of parameters
-for trace_name in trace_files:
-    trace_path = os.path.join(traces_dir, trace_name)
-    base_name = os.path.splitext(trace_name)[0]
-    for k0, k1, k2, R, F in itertools.product(k0_values, k1_values, k2_values, result_buses, fetch_rates):
-        # Construct an output filename reflecting the configuration
-        out_filename = f"{base_name}_j{k0}_k{k1}_l{k2}_r{R}_f{F}.out"
-        out_path = os.path.join(output_dir, out_filename)
-
-        # Build the command-line invocation
-        cmd = [
-            sim_executable,
-            "-r", str(R),
-            "-j", str(k0),
-            "-k", str(k1),
-            "-l", str(k2),
-            "-f", str(F)
-        ]
-
-        # Run the simulator, feeding the trace file on stdin,
-        # and capturing both stdout and stderr to the output file.
-        with open(trace_path, "r") as trace_fh, open(out_path, "w") as out_fh:
-            subprocess.run(cmd, stdin=trace_fh, stdout=out_fh, stderr=subprocess.STDOUT)
-
-        print(f"Completed: {trace_name} [j={k0}, k={k1}, l={k2}, r={R}, f={F}] → {out_filename}")
+trace_files = sorted(f for f in os.listdir(traces_dir) if f.endswith(".trace"))
+trace_paths = [os.path.join(traces_dir, f) for f in trace_files]
+
+def values(vs):
+    return ",".join(str(v) for v in vs)
+
+# One procsim process reads each trace once and simulates every
+# combination of parameters on all CPUs, writing one row per run
+out_path = os.path.join(output_dir, "sweep.csv")
+cmd = [
+    sim_executable, "-S",
+    "-r", values(result_buses),
+    "-j", values(k0_values),
+    "-k", values(k1_values),
+    "-l", values(k2_values),
+    "-f", values(fetch_rates),
+    "-o", out_path
+] + trace_paths
+subprocess.run(cmd, check=True)
+
+print(f"Completed: {', '.join(trace_files)} → {out_path}")
@@ -0,0 +1,124 @@
+// sampling.cpp
+#include "sampling.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace
+{
+        // Keeps, of the timeline of one sample's detailed simulation, the
+        // cycle by which every warm-up instruction had written back, and
+        // the one by which every instruction had
+        class SampleTimeline : public TimelineWriter
+        {
+        public:
+                explicit SampleTimeline(uint64_t warmup) : warmup(warmup) {}
+                void begin() override {}
+                void row(const int *stages) override
+                {
+                        if (static_cast<uint64_t>(stages[STAGE_INST]) <= warmup)
+                                warmedUp = std::max(warmedUp, stages[STAGE_STATE]);
+                        done = std::max(done, stages[STAGE_STATE]);
+                }
+                void end() override {}
+
+                int warmedUp = 0;
+                int done = 0;
+
+        private:
+                uint64_t warmup;
+        };
+} // end anonymous namespace
+
+int run_sampling(const sampling_spec_t &spec, TraceReader &trace)
+{
+        auto start = std::chrono::steady_clock::now();
+        uint64_t window = spec.warmup + spec.measure;
+
+        // One predictor sees every branch, whether fast-forwarded or
+        // simulated, so each sample starts with it warm
+        std::unique_ptr<branch_predictor> predictor(make_branch_predictor(spec.options.predictor));
+        proc_options_t options = spec.options;
+        options.predictor = BP_PERFECT;
+
+        // A branch is checked once the instruction after it is read
+        trace_record_t last;
+        bool haveLast = false;
+        auto train = [&](const trace_record_t &rec) {
+                if (predictor && haveLast && last.op_code == -1)
+                        predict_branch(predictor.get(), last.instruction_address, rec.instruction_address);
+                last = rec;
+                haveLast = true;
+        };
+
+        std::vector<double> cpi;
+        std::vector<trace_record_t> records;
+        records.reserve(window);
+        uint64_t total = 0;
+        trace_record_t rec;
+        for (;;)
+        {
+                uint64_t skipped = 0;
+                while (skipped < spec.period - window && trace.next(&rec))
+                {
+                        train(rec);
+                        ++skipped;
+                }
+                total += skipped;
+                if (skipped < spec.period - window)
+                        break;
+
+                // A sample cut short by the end of the trace isn't timed
+                records.clear();
+                while (records.size() < window && trace.next(&rec))
+                        records.push_back(rec);
+                total += records.size();
+                if (records.size() < window)
+                        break;
+                train(records.front());
+
+                Processor processor(spec.r, spec.k0, spec.k1, spec.k2, spec.f, options);
+                if (predictor)
+                        processor.sharePredictor(predictor.get());
+                TraceBufferSource source(records);
+                SampleTimeline timeline(spec.warmup);
+                processor.run(source, &timeline);
+                cpi.push_back(static_cast<double>(timeline.done - timeline.warmedUp) / spec.measure);
+                last = records.back();
+        }
+
+        size_t n = cpi.size();
+        if (n == 0)
+        {
+                fprintf(stderr, "The trace has fewer than %" PRIu64 " instructions to sample\n", spec.period);
+                return 1;
+        }
+        double mean = 0, variance = 0;
+        for (auto c : cpi)
+                mean += c;
+        mean /= n;
+        for (auto c : cpi)
+                variance += (c - mean) * (c - mean);
+        variance = n > 1 ? variance / (n - 1) : 0;
+        double half = SAMPLING_Z * std::sqrt(variance / n);
+
+        printf("Sampled simulation:\n");
+        printf("Instructions: %" PRIu64 " (%" PRIu64 " simulated in detail, %.2f%%)\n", total, n * window,
+               100.0 * n * window / total);
+        printf("Samples: %zu of %" PRIu64 " instructions, each after %" PRIu64 " of warm-up\n", n, spec.measure,
+               spec.warmup);
+        printf("Cycles per instruction: mean %f, coefficient of variation %f\n", mean, std::sqrt(variance) / mean);
+        if (n > 1)
+                printf("Estimated IPC: %f (95%% confidence %f to %f, +/-%.2f%%)\n", 1 / mean, 1 / (mean + half),
+                       mean > half ? 1 / (mean - half) : INFINITY, 100 * half / mean);
+        else
+                printf("Estimated IPC: %f (one sample, no confidence interval)\n", 1 / mean);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        fprintf(stderr, "%zu samples in %.2f s\n", n, seconds);
+        return 0;
+}
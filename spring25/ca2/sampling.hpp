@@ -0,0 +1,32 @@
+// sampling.hpp
+#ifndef SAMPLING_HPP
+#define SAMPLING_HPP
+
+#include <cstdint>
+#include "procsim.hpp"
+#include "trace_reader.hpp"
+
+// Standard errors either side of the sampled CPI that its confidence
+// interval spans (95%)
+#define SAMPLING_Z 1.96
+
+// Sampled simulation, after SMARTS.  Out of every period instructions,
+// the last warmup + measure are simulated in detail from an empty
+// pipeline, and only how long the final measure of them take counts.
+// The rest are fast-forwarded: they are only read, which leaves every
+// register ready (what the scoreboard would hold once they had
+// executed), and a branch predictor is trained on their branches.
+typedef struct _sampling_spec_t
+{
+    uint64_t r, k0, k1, k2, f; // the machine
+    proc_options_t options;    // the same for every sample
+    uint64_t period;           // instructions from one sample to the next
+    uint64_t warmup;           // simulated in detail before each sample
+    uint64_t measure;          // in each sample
+} sampling_spec_t;
+
+// Samples the trace and prints the estimated IPC with its confidence
+// interval, returning the process exit status
+int run_sampling(const sampling_spec_t &spec, TraceReader &trace);
+
+#endif // SAMPLING_HPP
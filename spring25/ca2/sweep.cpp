@@ -0,0 +1,347 @@
+// sweep.cpp
+#include "sweep.hpp"
+#include "trace_reader.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+        // One machine configuration, in the order of the minimal search's
+        // tie-break after cost
+        struct Config
+        {
+                uint64_t r, k0, k1, k2, f;
+
+                uint64_t cost() const
+                {
+                        return k0 + k1 + k2 + r;
+                }
+
+                // True if no resource count here is larger than in o
+                bool within(const Config &o) const
+                {
+                        return r <= o.r && k0 <= o.k0 && k1 <= o.k1 && k2 <= o.k2;
+                }
+        };
+
+        struct Result
+        {
+                Config config;
+                proc_stats_t stats;
+                proc_util_t util;
+        };
+
+        // Runs jobs 0..count-1 on a pool of threads.  Each thread starts on
+        // its own contiguous share of the jobs and, when that runs out,
+        // steals from the far end of another thread's share.
+        void run_jobs(size_t count, unsigned threads, const std::function<void(size_t)> &job)
+        {
+                threads = std::max(1u, std::min<unsigned>(threads, count));
+                std::vector<std::deque<size_t>> queues(threads);
+                std::vector<std::mutex> locks(threads);
+                for (size_t i = 0; i < count; i++)
+                        queues[i * threads / count].push_back(i);
+
+                auto worker = [&](unsigned self) {
+                        for (;;)
+                        {
+                                size_t next = 0;
+                                bool found = false;
+                                for (unsigned k = 0; k < threads && !found; k++)
+                                {
+                                        unsigned victim = (self + k) % threads;
+                                        std::lock_guard<std::mutex> guard(locks[victim]);
+                                        auto &q = queues[victim];
+                                        if (q.empty())
+                                                continue;
+                                        if (victim == self)
+                                        {
+                                                next = q.front();
+                                                q.pop_front();
+                                        }
+                                        else
+                                        {
+                                                next = q.back();
+                                                q.pop_back();
+                                        }
+                                        found = true;
+                                }
+                                if (!found)
+                                        return; // nothing is ever added, so we're done
+                                job(next);
+                        }
+                };
+
+                std::vector<std::thread> pool;
+                for (unsigned t = 1; t < threads; t++)
+                        pool.emplace_back(worker, t);
+                worker(0);
+                for (auto &t : pool)
+                        t.join();
+        }
+
+        // The trace's file name without its directory or extension
+        std::string trace_name(const std::string &path)
+        {
+                size_t slash = path.find_last_of('/');
+                std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+                size_t dot = name.find_last_of('.');
+                return dot == std::string::npos ? name : name.substr(0, dot);
+        }
+
+        Result simulate(const std::vector<trace_record_t> &trace, const Config &c,
+                        const proc_options_t &options)
+        {
+                TraceBufferSource source(trace);
+                Processor processor(c.r, c.k0, c.k1, c.k2, c.f, options);
+                processor.run(source, nullptr);
+                Result result;
+                result.config = c;
+                memset(&result.stats, 0, sizeof(result.stats));
+                processor.complete(&result.stats);
+                result.util = processor.utilization();
+                return result;
+        }
+
+        // Every combination of the spec's values with fetch width f
+        std::vector<Config> configs_for(const sweep_spec_t &spec, uint64_t f)
+        {
+                std::vector<Config> configs;
+                for (auto k0 : spec.k0)
+                        for (auto k1 : spec.k1)
+                                for (auto k2 : spec.k2)
+                                        for (auto r : spec.r)
+                                                configs.push_back({r, k0, k1, k2, f});
+                return configs;
+        }
+
+        // Cheapest first, then fewest result buses, then fewest FUs of
+        // each type
+        bool cheaper(const Config &a, const Config &b)
+        {
+                if (a.cost() != b.cost())
+                        return a.cost() < b.cost();
+                if (a.r != b.r)
+                        return a.r < b.r;
+                if (a.k0 != b.k0)
+                        return a.k0 < b.k0;
+                if (a.k1 != b.k1)
+                        return a.k1 < b.k1;
+                return a.k2 < b.k2;
+        }
+
+        // The cheapest configuration of one trace and fetch width reaching
+        // SWEEP_THRESHOLD of the best IPC, along with that best IPC.
+        // Assumes more of any resource never lowers IPC: the best is then
+        // the largest configuration, and anything within a configuration
+        // that falls short falls short too, so it isn't simulated.
+        struct Minimal
+        {
+                Result best;
+                double maxIpc;
+                size_t simulated;
+        };
+
+        Minimal search_minimal(const sweep_spec_t &spec, const std::vector<trace_record_t> &trace,
+                               const std::vector<Config> &candidates, const std::vector<Result> *known)
+        {
+                Minimal m;
+                m.simulated = 0;
+                auto ipc_of = [&](const Config &c) {
+                        if (known != nullptr)
+                                for (auto &r : *known)
+                                        if (!cheaper(r.config, c) && !cheaper(c, r.config))
+                                                return r;
+                        ++m.simulated;
+                        return simulate(trace, c, spec.options);
+                };
+
+                // With every result to hand the best is simply the best
+                if (known != nullptr)
+                {
+                        m.maxIpc = 0;
+                        for (auto &r : *known)
+                                m.maxIpc = std::max(m.maxIpc, static_cast<double>(r.stats.avg_inst_retired));
+                }
+                else
+                {
+                        Config largest = candidates.front();
+                        for (auto &c : candidates)
+                        {
+                                largest.r = std::max(largest.r, c.r);
+                                largest.k0 = std::max(largest.k0, c.k0);
+                                largest.k1 = std::max(largest.k1, c.k1);
+                                largest.k2 = std::max(largest.k2, c.k2);
+                        }
+                        m.maxIpc = ipc_of(largest).stats.avg_inst_retired;
+                }
+
+                std::vector<Config> order(candidates);
+                std::sort(order.begin(), order.end(), cheaper);
+                std::vector<Config> shortfalls;
+                for (auto &c : order)
+                {
+                        bool dominated = false;
+                        for (auto &s : shortfalls)
+                                dominated = dominated || c.within(s);
+                        if (dominated && known == nullptr)
+                                continue;
+                        Result r = ipc_of(c);
+                        if (r.stats.avg_inst_retired >= SWEEP_THRESHOLD * m.maxIpc)
+                        {
+                                m.best = r;
+                                return m;
+                        }
+                        shortfalls.push_back(c);
+                }
+                m.best = ipc_of(order.back()); // only if more resources ever cost IPC
+                return m;
+        }
+
+        FILE *open_csv(const char *path)
+        {
+                FILE *f = fopen(path, "w");
+                if (f == NULL)
+                        fprintf(stderr, "Failed to open %s for writing\n", path);
+                return f;
+        }
+} // end anonymous namespace
+
+bool parse_sweep_values(const char *text, std::vector<uint64_t> &values)
+{
+        values.clear();
+        const char *p = text;
+        while (*p != '\0')
+        {
+                char *end;
+                uint64_t lo = strtoull(p, &end, 10);
+                if (end == p)
+                        return false;
+                uint64_t hi = lo;
+                p = end;
+                if (*p == '-')
+                {
+                        hi = strtoull(p + 1, &end, 10);
+                        if (end == p + 1 || hi < lo)
+                                return false;
+                        p = end;
+                }
+                for (uint64_t v = lo; v <= hi; v++)
+                        values.push_back(v);
+                if (*p == ',')
+                        ++p;
+                else if (*p != '\0')
+                        return false;
+        }
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end()), values.end());
+        return !values.empty();
+}
+
+int run_sweep(const sweep_spec_t &spec)
+{
+        auto start = std::chrono::steady_clock::now();
+        unsigned threads = spec.threads != 0 ? spec.threads : std::max(1u, std::thread::hardware_concurrency());
+
+        // Every trace is read once and shared by all of its runs
+        std::vector<std::vector<trace_record_t>> traces(spec.traces.size());
+        for (size_t t = 0; t < traces.size(); t++)
+                if (!load_trace(spec.traces[t], traces[t]))
+                        return 1;
+
+        std::vector<std::vector<Config>> byFetch;
+        for (auto f : spec.f)
+                byFetch.push_back(configs_for(spec, f));
+        size_t perTrace = byFetch.size() * byFetch[0].size();
+        std::atomic<size_t> simulated(0);
+
+        // Every configuration of every trace, if asked for
+        std::vector<Result> results;
+        if (spec.results != nullptr)
+        {
+                results.resize(traces.size() * perTrace);
+                run_jobs(results.size(), threads, [&](size_t i) {
+                        const Config &c = byFetch[i % perTrace / byFetch[0].size()][i % byFetch[0].size()];
+                        results[i] = simulate(traces[i / perTrace], c, spec.options);
+                        ++simulated;
+                });
+
+                FILE *out = open_csv(spec.results);
+                if (out == NULL)
+                        return 1;
+                fprintf(out, "trace,k0,k1,k2,R,F,IPC,cycles,instructions,avg_disp_size,max_disp_size,avg_inst_fired,"
+                             "fu0_util,fu1_util,fu2_util,cdb_util,rs_util,"
+                             "stall_source,stall_fu,stall_cdb,stall_rs_full,fetch_lost,stall_rob_full,stall_regs_full\n");
+                for (size_t i = 0; i < results.size(); i++)
+                {
+                        const Config &c = results[i].config;
+                        const proc_stats_t &s = results[i].stats;
+                        const proc_util_t &u = results[i].util;
+                        fprintf(out, "%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%f,%lu,%lu,%f,%lu,%f,",
+                                trace_name(spec.traces[i / perTrace]).c_str(), c.k0, c.k1, c.k2, c.r, c.f,
+                                s.avg_inst_retired, s.cycle_count, s.retired_instruction,
+                                s.avg_disp_size, s.max_disp_size, s.avg_inst_fired);
+
+                        // Utilization as a fraction of each resource
+                        fprintf(out, "%f,%f,%f,%f,%f,", util_mean(u.fu_busy[0]) / c.k0, util_mean(u.fu_busy[1]) / c.k1,
+                                util_mean(u.fu_busy[2]) / c.k2, util_mean(u.cdb_busy) / c.r,
+                                util_mean(u.rs_busy) / (2 * (c.k0 + c.k1 + c.k2)));
+                        fprintf(out, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+                                u.stall_source, u.stall_fu, u.stall_cdb, u.stall_rs_full, u.fetch_lost,
+                                u.stall_rob_full, u.stall_regs_full);
+                }
+                fclose(out);
+        }
+
+        // The cheapest configuration for each trace and fetch width, reusing
+        // the full results if there are any
+        if (spec.minimal != nullptr)
+        {
+                size_t searches = traces.size() * byFetch.size();
+                std::vector<Minimal> minimal(searches);
+                run_jobs(searches, threads, [&](size_t i) {
+                        size_t t = i / byFetch.size(), fi = i % byFetch.size();
+                        std::vector<Result> known;
+                        if (!results.empty())
+                                known.assign(results.begin() + t * perTrace + fi * byFetch[0].size(),
+                                             results.begin() + t * perTrace + (fi + 1) * byFetch[0].size());
+                        minimal[i] = search_minimal(spec, traces[t], byFetch[fi], known.empty() ? nullptr : &known);
+                        simulated += minimal[i].simulated;
+                });
+
+                // In the same order analyze_results.py writes them
+                std::vector<size_t> order(searches);
+                for (size_t i = 0; i < searches; i++)
+                        order[i] = i;
+                std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+                        return trace_name(spec.traces[a / byFetch.size()]) < trace_name(spec.traces[b / byFetch.size()]);
+                });
+
+                FILE *out = open_csv(spec.minimal);
+                if (out == NULL)
+                        return 1;
+                fprintf(out, "trace,k0,k1,k2,R,F,IPC,cost,max_ipc\n");
+                for (auto i : order)
+                {
+                        const Config &c = minimal[i].best.config;
+                        fprintf(out, "%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%f,%" PRIu64 ",%f\n",
+                                trace_name(spec.traces[i / byFetch.size()]).c_str(), c.k0, c.k1, c.k2, c.r, c.f,
+                                minimal[i].best.stats.avg_inst_retired, c.cost(), minimal[i].maxIpc);
+                }
+                fclose(out);
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        fprintf(stderr, "%zu simulations of %zu configurations on %u threads in %.2f s\n",
+                simulated.load(), traces.size() * perTrace, threads, seconds);
+        return 0;
+}
@@ -0,0 +1,36 @@
+// sweep.hpp
+#ifndef SWEEP_HPP
+#define SWEEP_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "procsim.hpp"
+
+// Fraction of the best IPC a minimal configuration has to reach
+#define SWEEP_THRESHOLD 0.95
+
+// A design-space sweep: every combination of the parameter values below,
+// for each trace
+typedef struct _sweep_spec_t
+{
+    std::vector<uint64_t> r, k0, k1, k2, f; // values of each parameter
+    std::vector<std::string> traces;        // trace files
+    proc_options_t options;                 // the same for every run
+    unsigned threads;                       // worker threads, 0 for one per CPU
+    const char *results;                    // CSV of every run, or nullptr
+    const char *minimal;                    // CSV of minimal configurations, or nullptr
+} sweep_spec_t;
+
+// Parses a list of values and ranges such as "1-4,8" into values; false if
+// it isn't one
+bool parse_sweep_values(const char *text, std::vector<uint64_t> &values);
+
+// Runs a sweep, returning the process exit status.  With a results file
+// every configuration is simulated; with only a minimal file, each trace
+// and fetch width is searched for its cheapest configuration within
+// SWEEP_THRESHOLD of the best, skipping configurations that are
+// dominated by one already known to fall short.
+int run_sweep(const sweep_spec_t &spec);
+
+#endif // SWEEP_HPP
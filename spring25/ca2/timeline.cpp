@@ -0,0 +1,168 @@
+// timeline.cpp
+#include "timeline.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace
+{
+        // Room for a row of NUM_STAGES ints and their separators
+        constexpr size_t MAX_ROW_BYTES = 6 * 12 + 1;
+        constexpr size_t TEXT_BUFFER_SIZE = 1 << 16;
+
+        // Formats v in decimal at p, returning the end
+        inline char *formatInt(char *p, int v)
+        {
+                unsigned u = static_cast<unsigned>(v);
+                if (v < 0)
+                {
+                        *p++ = '-';
+                        u = 0u - u;
+                }
+                char digits[10];
+                int n = 0;
+                do
+                {
+                        digits[n++] = '0' + u % 10;
+                        u /= 10;
+                } while (u != 0);
+                while (n > 0)
+                        *p++ = digits[--n];
+                return p;
+        }
+} // end anonymous namespace
+
+TextTimeline::TextTimeline(FILE *o, bool p)
+    : out(o), piped(p), buffer(TEXT_BUFFER_SIZE), used(0)
+{
+}
+
+TextTimeline::~TextTimeline()
+{
+        if (piped)
+                pclose(out);
+        else if (out != stdout)
+                fclose(out);
+}
+
+void TextTimeline::flush()
+{
+        fwrite(buffer.data(), 1, used, out);
+        used = 0;
+}
+
+void TextTimeline::begin()
+{
+        fputs("INST\tFETCH\tDISP\tSCHED\tEXEC\tSTATE\n", out);
+}
+
+void TextTimeline::row(const int *stages)
+{
+        if (buffer.size() - used < MAX_ROW_BYTES)
+                flush();
+        char *p = buffer.data() + used;
+        for (int j = 0; j < 6; ++j)
+        {
+                p = formatInt(p, stages[j]);
+                *p++ = '\t';
+        }
+        *p++ = '\n';
+        used = p - buffer.data();
+}
+
+void TextTimeline::end()
+{
+        flush();
+        fputs("\n", out);
+        fflush(out);
+}
+
+BinaryTimeline::BinaryTimeline(FILE *o)
+    : out(o), first(1), next(1)
+{
+        for (auto &c : columns)
+                c.reserve(TIMELINE_BLOCK_ROWS);
+}
+
+BinaryTimeline::~BinaryTimeline()
+{
+        fclose(out);
+}
+
+void BinaryTimeline::flush()
+{
+        uint32_t count = columns[0].size();
+        fwrite(&first, sizeof(first), 1, out);
+        fwrite(&count, sizeof(count), 1, out);
+        for (auto &c : columns)
+        {
+                fwrite(c.data(), sizeof(int32_t), c.size(), out);
+                c.clear();
+        }
+        first = next;
+}
+
+void BinaryTimeline::begin()
+{
+        fwrite(TIMELINE_MAGIC, 1, 8, out);
+}
+
+void BinaryTimeline::row(const int *stages)
+{
+        for (int j = 0; j < 5; ++j)
+                columns[j].push_back(stages[j + 1]);
+        ++next;
+        if (columns[0].size() == TIMELINE_BLOCK_ROWS)
+                flush();
+}
+
+void BinaryTimeline::end()
+{
+        if (!columns[0].empty())
+                flush();
+        flush(); // the empty block that ends the file
+        fflush(out);
+}
+
+TimelineWriter *open_timeline(TimelineFormat format, const char *path)
+{
+        FILE *out = stdout;
+        switch (format)
+        {
+        case TIMELINE_NONE:
+                return nullptr;
+        case TIMELINE_TEXT:
+                if (path != nullptr)
+                        out = fopen(path, "w");
+                break;
+        case TIMELINE_BINARY:
+                out = path != nullptr ? fopen(path, "wb") : nullptr;
+                break;
+        case TIMELINE_GZIP:
+                if (path != nullptr)
+                {
+                        // gzip does the compressing so procsim needs no library
+                        std::string command = "gzip -c > '";
+                        for (const char *p = path; *p != '\0'; p++)
+                                command += *p == '\'' ? std::string("'\\''") : std::string(1, *p);
+                        command += "'";
+                        out = popen(command.c_str(), "w");
+                }
+                else
+                {
+                        out = nullptr;
+                }
+                break;
+        }
+        if (out == nullptr)
+        {
+                if (path == nullptr)
+                        fprintf(stderr, "Binary and compressed timelines need a file (-O)\n");
+                else
+                        fprintf(stderr, "Failed to open %s for writing\n", path);
+                exit(1);
+        }
+        if (format == TIMELINE_BINARY)
+                return new BinaryTimeline(out);
+        return new TextTimeline(out, format == TIMELINE_GZIP);
+}
@@ -0,0 +1,89 @@
+// timeline.hpp
+#ifndef TIMELINE_HPP
+#define TIMELINE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// How procsim writes its per-instruction timeline
+enum TimelineFormat
+{
+    TIMELINE_TEXT = 0, // tab-separated text, the assignment's format
+    TIMELINE_NONE,     // no timeline, statistics only
+    TIMELINE_BINARY,   // binary columns, see below
+    TIMELINE_GZIP      // the text format through gzip
+};
+
+// Binary timeline format
+//
+// TIMELINE_MAGIC and then blocks of up to TIMELINE_BLOCK_ROWS rows, each a
+// uint64_t INST of its first row, a uint32_t row count and then, for each
+// of FETCH, DISP, SCHED, EXEC and STATE in turn, that many int32_t.  INST
+// goes up by one each row.  A block of zero rows ends the file.  All
+// fields are little-endian.
+#define TIMELINE_MAGIC "PSIMTL01"
+#define TIMELINE_BLOCK_ROWS 4096
+
+// Receives the timeline rows, in instruction order
+class TimelineWriter
+{
+public:
+    virtual ~TimelineWriter() {}
+
+    // Called once before the first row
+    virtual void begin() = 0;
+
+    // One instruction: INST, FETCH, DISP, SCHED, EXEC and STATE
+    virtual void row(const int *stages) = 0;
+
+    // Called once after the last row; writes out anything buffered
+    virtual void end() = 0;
+};
+
+// The text format, formatted into a large buffer by hand rather than
+// through printf
+class TextTimeline : public TimelineWriter
+{
+public:
+    // Writes to out, which it closes with pclose if piped
+    explicit TextTimeline(FILE *out, bool piped = false);
+    ~TextTimeline();
+    void begin() override;
+    void row(const int *stages) override;
+    void end() override;
+
+private:
+    void flush();
+
+    FILE *out;
+    bool piped;
+    std::vector<char> buffer;
+    size_t used;
+};
+
+// The binary format
+class BinaryTimeline : public TimelineWriter
+{
+public:
+    explicit BinaryTimeline(FILE *out);
+    ~BinaryTimeline();
+    void begin() override;
+    void row(const int *stages) override;
+    void end() override;
+
+private:
+    void flush();
+
+    FILE *out;
+    uint64_t first; // INST of the first buffered row
+    uint64_t next;  // INST of the next row
+    std::vector<int32_t> columns[5];
+};
+
+// Opens a timeline in the given format on path, or on stdout if path is
+// nullptr and the format is text.  Returns nullptr for TIMELINE_NONE, and
+// exits with a message if the file can't be opened.
+TimelineWriter *open_timeline(TimelineFormat format, const char *path);
+
+#endif // TIMELINE_HPP
@@ -0,0 +1,147 @@
+// trace_convert.cpp
+// Converts a text trace to the binary format described in trace_reader.hpp,
+// or with -d, any trace back to text.  Binary traces are about a third the
+// size of text ones and procsim reads them without parsing.
+//
+//   trace_convert traces/gcc.100k.trace traces/gcc.100k.btrace
+//   trace_convert -d traces/gcc.100k.btrace > gcc.100k.trace
+#include "trace_reader.hpp"
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+        void print_help_and_exit(void)
+        {
+                fprintf(stderr, "trace_convert [OPTIONS] [in [out]]\n");
+                fprintf(stderr, "  -d\t\tWrite a text trace instead of a binary one\n");
+                fprintf(stderr, "  -h\t\tThis helpful output\n");
+                fprintf(stderr, "in and out default to stdin and stdout\n");
+                exit(1);
+        }
+
+        bool fits(int32_t v)
+        {
+                return v >= INT8_MIN && v <= INT8_MAX;
+        }
+
+        // Writes the records of one block, if there are any
+        bool write_block(FILE *out, uint32_t base_pc, std::vector<btrace_record_t> &records)
+        {
+                if (records.empty())
+                        return true;
+                btrace_block_t header;
+                header.base_pc = base_pc;
+                header.count = records.size();
+                bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+                          fwrite(records.data(), sizeof(btrace_record_t), records.size(), out) == records.size();
+                records.clear();
+                return ok;
+        }
+} // end anonymous namespace
+
+int main(int argc, char *argv[])
+{
+        bool text = false;
+        int opt;
+        while (-1 != (opt = getopt(argc, argv, "dh")))
+        {
+                switch (opt)
+                {
+                case 'd':
+                        text = true;
+                        break;
+                case 'h':
+                default:
+                        print_help_and_exit();
+                        break;
+                }
+        }
+        if (argc - optind > 2)
+                print_help_and_exit();
+
+        FILE *in = stdin;
+        FILE *out = stdout;
+        if (optind < argc && (in = fopen(argv[optind], "r")) == NULL)
+        {
+                fprintf(stderr, "Failed to open %s for reading\n", argv[optind]);
+                return 1;
+        }
+        if (optind + 1 < argc && (out = fopen(argv[optind + 1], "wb")) == NULL)
+        {
+                fprintf(stderr, "Failed to open %s for writing\n", argv[optind + 1]);
+                return 1;
+        }
+
+        TraceReader reader;
+        reader.open(in);
+        trace_record_t rec;
+
+        if (text)
+        {
+                while (reader.next(&rec))
+                        fprintf(out, "%" PRIx32 " %d %d %d %d\n", rec.instruction_address,
+                                rec.op_code, rec.dest_reg, rec.src_reg[0], rec.src_reg[1]);
+                return fclose(out) == 0 ? 0 : 1;
+        }
+
+        // The header's count is filled in once we know it
+        btrace_header_t header;
+        memcpy(header.magic, BTRACE_MAGIC, 8);
+        header.count = 0;
+        if (fwrite(&header, sizeof(header), 1, out) != 1)
+        {
+                fprintf(stderr, "Failed to write the trace\n");
+                return 1;
+        }
+
+        std::vector<btrace_record_t> records;
+        records.reserve(BTRACE_BLOCK_RECORDS);
+        uint32_t base_pc = 0;
+        uint32_t pc = 0;
+        bool ok = true;
+        while (ok && reader.next(&rec))
+        {
+                if (!fits(rec.op_code) || !fits(rec.dest_reg) ||
+                    !fits(rec.src_reg[0]) || !fits(rec.src_reg[1]))
+                {
+                        fprintf(stderr, "Instruction %" PRIu64 " has a field out of range\n",
+                                header.count + 1);
+                        return 1;
+                }
+
+                // Start a new block when it's full or the jump is too far
+                int32_t delta = static_cast<int32_t>(rec.instruction_address - pc);
+                if (records.empty() || records.size() == BTRACE_BLOCK_RECORDS ||
+                    delta < INT16_MIN || delta > INT16_MAX)
+                {
+                        ok = write_block(out, base_pc, records);
+                        base_pc = pc = rec.instruction_address;
+                        delta = 0;
+                }
+
+                btrace_record_t r;
+                r.pc_delta = delta;
+                r.op_code = rec.op_code;
+                r.dest_reg = rec.dest_reg;
+                r.src_reg[0] = rec.src_reg[0];
+                r.src_reg[1] = rec.src_reg[1];
+                records.push_back(r);
+                pc = rec.instruction_address;
+                header.count++;
+        }
+        ok = ok && write_block(out, base_pc, records);
+
+        // Patch the count in if we can seek back to it
+        if (ok && fseek(out, 0, SEEK_SET) == 0)
+                ok = fwrite(&header, sizeof(header), 1, out) == 1;
+        if (fclose(out) != 0 || !ok)
+        {
+                fprintf(stderr, "Failed to write the trace\n");
+                return 1;
+        }
+        return 0;
+}
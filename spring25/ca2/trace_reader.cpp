@@ -0,0 +1,334 @@
+// trace_reader.cpp
+#include "trace_reader.hpp"
+#include <cstring>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+        // Value of each hex digit, -1 for anything else
+        struct HexTable
+        {
+                int8_t value[256];
+                HexTable()
+                {
+                        memset(value, -1, sizeof(value));
+                        for (int c = '0'; c <= '9'; c++)
+                                value[c] = c - '0';
+                        for (int c = 'a'; c <= 'f'; c++)
+                                value[c] = value[c - 'a' + 'A'] = c - 'a' + 10;
+                }
+        } const hexTable;
+
+        // Whitespace as isspace() sees it in the C locale
+        inline bool isSpace(char c)
+        {
+                return c == ' ' || (c >= '\t' && c <= '\r');
+        }
+
+        inline const char *skipSpace(const char *p, const char *end)
+        {
+                while (p < end && isSpace(*p))
+                        ++p;
+                return p;
+        }
+
+        // Parses an optionally signed decimal; false if there are no digits
+        inline bool parseDecimal(const char *&p, const char *end, int32_t *out)
+        {
+                p = skipSpace(p, end);
+                bool negative = false;
+                if (p < end && (*p == '-' || *p == '+'))
+                        negative = *p++ == '-';
+                const char *start = p;
+                uint32_t v = 0;
+                while (p < end && static_cast<unsigned>(*p - '0') < 10)
+                        v = v * 10 + (*p++ - '0');
+                *out = static_cast<int32_t>(negative ? 0u - v : v);
+                return p != start;
+        }
+} // end anonymous namespace
+
+TraceReader::TraceReader()
+    : file(nullptr), fd(-1), cur(nullptr), end(nullptr), mapping(nullptr),
+      mappingSize(0), blockLen(0), eof(false), done(false), binary(false),
+      batchPos(0), parsed(0), scan(nullptr), scanned(0), scanDone(false)
+{
+        batch.reserve(TRACE_BATCH_SIZE);
+}
+
+TraceReader::~TraceReader()
+{
+        if (mapping != nullptr)
+                munmap(const_cast<char *>(mapping), mappingSize);
+}
+
+bool TraceReader::open(FILE *f)
+{
+        file = f;
+        fd = fileno(f);
+        batch.clear();
+        batchPos = 0;
+        parsed = scanned = 0;
+        scan = nullptr;
+        eof = done = binary = scanDone = false;
+
+        // Map regular files (including a file redirected to stdin) whole
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+        {
+                mappingSize = st.st_size;
+                if (mappingSize == 0)
+                {
+                        eof = done = true;
+                        return true;
+                }
+                void *p = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED)
+                {
+                        madvise(p, mappingSize, MADV_SEQUENTIAL);
+                        mapping = static_cast<const char *>(p);
+                        cur = mapping;
+                        end = mapping + mappingSize;
+                        eof = true;
+                        return checkBinary();
+                }
+        }
+
+        // Otherwise read it a block at a time
+        block.resize(TRACE_BLOCK_SIZE);
+        cur = end = block.data();
+        blockLen = 0;
+        refill();
+        if (blockLen < sizeof(btrace_header_t) ||
+            memcmp(block.data(), BTRACE_MAGIC, 8) != 0)
+                return true;
+
+        // Binary traces don't come in lines, so read the whole thing in
+        while (!eof)
+        {
+                block.resize(block.size() * 2);
+                size_t want = block.size() - blockLen;
+                size_t got = fread(block.data() + blockLen, 1, want, file);
+                blockLen += got;
+                eof = got < want;
+        }
+        cur = block.data();
+        end = cur + blockLen;
+        return checkBinary();
+}
+
+// Recognizes a binary trace at cur and skips its header
+bool TraceReader::checkBinary()
+{
+        btrace_header_t header;
+        if (static_cast<size_t>(end - cur) < sizeof(header))
+                return true;
+        memcpy(&header, cur, sizeof(header));
+        if (memcmp(header.magic, BTRACE_MAGIC, 8) != 0)
+                return true;
+        binary = true;
+        cur += sizeof(header);
+
+        // A converter writing to a pipe can't fill the count in, so add up
+        // the blocks instead
+        scanned = header.count;
+        if (scanned == 0)
+        {
+                btrace_block_t b;
+                for (const char *p = cur; end - p >= static_cast<ptrdiff_t>(sizeof(b));
+                     p += sizeof(b) + b.count * sizeof(btrace_record_t))
+                {
+                        memcpy(&b, p, sizeof(b));
+                        scanned += b.count;
+                }
+        }
+        scanDone = true;
+        return true;
+}
+
+// Reads the next block, keeping any partial line left over from the last
+// one.  Only complete lines are exposed to the parser until the input runs
+// out, so an instruction never straddles two blocks.
+bool TraceReader::refill()
+{
+        if (eof)
+                return false;
+        size_t partial = blockLen - (end - block.data());
+        memmove(block.data(), end, partial);
+        size_t want = block.size() - partial;
+        size_t got = fread(block.data() + partial, 1, want, file);
+        blockLen = partial + got;
+        eof = got < want;
+
+        cur = block.data();
+        end = cur + blockLen;
+        if (!eof)
+        {
+                const char *nl = static_cast<const char *>(memrchr(cur, '\n', blockLen));
+                if (nl != nullptr)
+                        end = nl + 1;
+        }
+        return cur != end;
+}
+
+// Parses one instruction at p and moves p past it; false if it isn't a
+// well-formed line
+bool TraceReader::parse(const char *&p, trace_record_t *rec)
+{
+        const char *q = p;
+
+        // PC in hex, with an optional 0x like %x allows
+        if (end - q > 2 && q[0] == '0' && (q[1] | 0x20) == 'x')
+                q += 2;
+        const char *start = q;
+        uint32_t pc = 0;
+        int8_t d;
+        while (q < end && (d = hexTable.value[static_cast<unsigned char>(*q)]) >= 0)
+        {
+                pc = (pc << 4) | d;
+                ++q;
+        }
+        if (q == start)
+                return false;
+        rec->instruction_address = pc;
+
+        if (!parseDecimal(q, end, &rec->op_code) ||
+            !parseDecimal(q, end, &rec->dest_reg) ||
+            !parseDecimal(q, end, &rec->src_reg[0]) ||
+            !parseDecimal(q, end, &rec->src_reg[1]))
+                return false;
+        p = q;
+        return true;
+}
+
+// Decodes the next block of a binary trace into the batch
+bool TraceReader::fillBinary()
+{
+        btrace_block_t header;
+        if (done || static_cast<size_t>(end - cur) < sizeof(header))
+        {
+                done = true;
+                return false;
+        }
+        memcpy(&header, cur, sizeof(header));
+        cur += sizeof(header);
+        if (header.count > BTRACE_BLOCK_RECORDS ||
+            static_cast<size_t>(end - cur) < header.count * sizeof(btrace_record_t))
+        {
+                fprintf(stderr, "Truncated or corrupt binary trace\n");
+                done = true;
+                return false;
+        }
+
+        batch.resize(header.count);
+        parsed += header.count;
+        uint32_t pc = header.base_pc;
+        for (uint32_t i = 0; i < header.count; i++)
+        {
+                btrace_record_t r;
+                memcpy(&r, cur, sizeof(r));
+                cur += sizeof(r);
+                pc += r.pc_delta;
+                batch[i].instruction_address = pc;
+                batch[i].op_code = r.op_code;
+                batch[i].dest_reg = r.dest_reg;
+                batch[i].src_reg[0] = r.src_reg[0];
+                batch[i].src_reg[1] = r.src_reg[1];
+        }
+        return !batch.empty() || fillBinary();
+}
+
+// Parses the next batch of instructions; false if there are none left
+bool TraceReader::fill()
+{
+        batch.clear();
+        batchPos = 0;
+        if (binary)
+                return fillBinary();
+        return fillText();
+}
+
+// Parses up to another TRACE_BATCH_SIZE text instructions onto the batch;
+// false if there were none left
+bool TraceReader::fillText()
+{
+        size_t before = batch.size();
+        while (!done && batch.size() - before < TRACE_BATCH_SIZE)
+        {
+                cur = skipSpace(cur, end);
+                if (cur == end)
+                {
+                        if (!refill())
+                                done = true;
+                        continue;
+                }
+                trace_record_t rec;
+                if (!parse(cur, &rec))
+                {
+                        done = true;
+                        break;
+                }
+                batch.push_back(rec);
+        }
+        parsed += batch.size() - before;
+        return batch.size() != before;
+}
+
+bool TraceReader::hasAtLeast(uint64_t n)
+{
+        if (n <= parsed || binary)
+                return n <= std::max(parsed, scanned);
+
+        // A mapped text trace: count ahead of the parser without keeping
+        // the instructions
+        if (mapping != nullptr)
+        {
+                if (scan == nullptr || scanned < parsed)
+                {
+                        scan = cur;
+                        scanned = parsed;
+                }
+                trace_record_t rec;
+                while (scanned < n && !scanDone)
+                {
+                        scan = skipSpace(scan, end);
+                        if (scan == end || !parse(scan, &rec))
+                                scanDone = true;
+                        else
+                                ++scanned;
+                }
+                return n <= scanned;
+        }
+
+        // Otherwise the only way to know is to read that far
+        batch.erase(batch.begin(), batch.begin() + batchPos);
+        batchPos = 0;
+        while (parsed < n && fillText())
+                ;
+        return n <= parsed;
+}
+
+void load_trace(FILE *file, std::vector<trace_record_t> &records)
+{
+        TraceReader reader;
+        reader.open(file);
+        trace_record_t rec;
+        while (reader.next(&rec))
+                records.push_back(rec);
+}
+
+bool load_trace(const std::string &path, std::vector<trace_record_t> &records)
+{
+        FILE *f = fopen(path.c_str(), "r");
+        if (f == NULL)
+        {
+                fprintf(stderr, "Failed to open %s for reading\n", path.c_str());
+                return false;
+        }
+        load_trace(f, records);
+        fclose(f);
+        return true;
+}
@@ -0,0 +1,129 @@
+// trace_reader.hpp
+#ifndef TRACE_READER_HPP
+#define TRACE_READER_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Number of instructions parsed at a time
+#define TRACE_BATCH_SIZE 4096
+
+// Bytes read at a time when the trace can't be mapped (e.g. a pipe)
+#define TRACE_BLOCK_SIZE (1 << 20)
+
+// One instruction as it appears in a trace: "<pc> <op> <dest> <src0> <src1>"
+typedef struct _trace_record_t
+{
+    uint32_t instruction_address; // Program counter (hex in text traces)
+    int32_t op_code;              // Operation type, -1 for branches
+    int32_t dest_reg;             // Destination register, -1 if none
+    int32_t src_reg[2];           // Source registers, -1 if none
+} trace_record_t;
+
+// Binary trace format
+//
+// A binary trace starts with a btrace_header_t and is followed by blocks of
+// at most BTRACE_BLOCK_RECORDS instructions.  Each block is a
+// btrace_block_t followed by that many fixed-width btrace_record_t.  PCs
+// are delta-encoded from the previous instruction in the block, starting
+// from the block's base_pc; a jump that doesn't fit in 16 bits starts a
+// new block.  All fields are little-endian.
+#define BTRACE_MAGIC "PSIMBTR1"
+#define BTRACE_BLOCK_RECORDS 4096
+
+typedef struct _btrace_header_t
+{
+    char magic[8];  // BTRACE_MAGIC, not NUL-terminated
+    uint64_t count; // Total instructions in the trace
+} btrace_header_t;
+
+typedef struct _btrace_block_t
+{
+    uint32_t base_pc; // PC the first record's delta is relative to
+    uint32_t count;   // Records in this block
+} btrace_block_t;
+
+typedef struct _btrace_record_t
+{
+    int16_t pc_delta;  // PC minus the previous instruction's PC
+    int8_t op_code;
+    int8_t dest_reg;
+    int8_t src_reg[2];
+} btrace_record_t;
+
+// Reads a text or binary trace into batches of trace_record_t.
+// A regular file is mmap'd and parsed in place; anything else (a pipe on
+// stdin) is read in TRACE_BLOCK_SIZE blocks.  Text fields are parsed with
+// a hand-written scanner that accepts what fscanf("%x %d %d %d %d") does
+// for well-formed traces, and stops at the first line it can't parse.
+// Binary traces are recognized by their magic number and decoded a block
+// at a time.
+class TraceReader
+{
+public:
+    TraceReader();
+    ~TraceReader();
+
+    // Start reading from file; the reader does not close it
+    bool open(FILE *file);
+
+    // Copies the next instruction into rec; false at end of trace
+    bool next(trace_record_t *rec)
+    {
+        if (batchPos == batch.size() && !fill())
+            return false;
+        *rec = batch[batchPos++];
+        return true;
+    }
+
+    // True if the trace holds at least n instructions in all, counting
+    // those already handed out.  Looks ahead without keeping what it reads
+    // when the trace is mapped or binary; a text trace on a pipe has to be
+    // parsed ahead and buffered.
+    bool hasAtLeast(uint64_t n);
+
+private:
+    bool fill();
+    bool fillText();
+    bool fillBinary();
+    bool checkBinary();
+    bool refill();
+    bool parse(const char *&p, trace_record_t *rec);
+
+    FILE *file;
+    int fd;
+
+    // Bytes being parsed: either the whole mapping or the current block
+    const char *cur;
+    const char *end;
+    const char *mapping;
+    size_t mappingSize;
+    std::vector<char> block;
+    size_t blockLen; // valid bytes in block
+    bool eof;    // no more bytes beyond end
+    bool done;   // hit end of trace or a bad line
+    bool binary; // reading the binary format
+
+    // Parsed instructions not yet handed out
+    std::vector<trace_record_t> batch;
+    size_t batchPos;
+    uint64_t parsed; // instructions put in batches so far
+
+    // Look-ahead for hasAtLeast: instructions counted up to scan in a
+    // mapped text trace, or the total of a binary trace
+    const char *scan;
+    uint64_t scanned;
+    bool scanDone;
+};
+
+// Reads the whole trace in file onto records; the file is left open
+void load_trace(FILE *file, std::vector<trace_record_t> &records);
+
+// Reads the whole trace in path onto records; false, with a message, if it
+// can't be opened
+bool load_trace(const std::string &path, std::vector<trace_record_t> &records);
+
+#endif // TRACE_READER_HPP